@@ -221,9 +221,12 @@ class MessageHandler : public CefMessageRouterBrowserSide::Handler {
 
             } break;
             case DataSegment::kMouseMoveReply: {
-              nlohmann::json obj = {{"t", "mouse_move"},
-                                    {"x", segment.mouse_move_reply().x()},
-                                    {"y", segment.mouse_move_reply().y()}};
+              nlohmann::json obj = {
+                  {"t", "mouse_move"},
+                  {"x", segment.mouse_move_reply().x()},
+                  {"y", segment.mouse_move_reply().y()},
+                  {"time", segment.mouse_move_reply().time()},
+                  {"coalesced", segment.mouse_move_reply().coalesced()}};
 
               to_browser.push_back(obj);
             } break;
@@ -232,7 +235,8 @@ class MessageHandler : public CefMessageRouterBrowserSide::Handler {
                   {"t", "mouse_press"},
                   {"state", segment.mouse_press_reply().state()},
                   {"x", segment.mouse_press_reply().x()},
-                  {"y", segment.mouse_press_reply().y()}};
+                  {"y", segment.mouse_press_reply().y()},
+                  {"time", segment.mouse_press_reply().time()}};
 
               to_browser.push_back(obj);
             } break;
@@ -0,0 +1,77 @@
+#include "allocation_counter.hpp"
+
+#ifdef DOTE_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+static thread_local uint64_t exempt_allocations = 0;
+
+// exemptions nest, only the outermost one counts
+static thread_local int exemption_depth = 0;
+static thread_local uint64_t exemption_start = 0;
+
+bool allocation_counting_enabled() {
+  return true;
+}
+
+uint64_t thread_allocation_count() {
+  return allocations - exempt_allocations;
+}
+
+AllocationExemption::AllocationExemption() {
+  if (exemption_depth++ == 0)
+    exemption_start = allocations;
+}
+
+AllocationExemption::~AllocationExemption() {
+  if (--exemption_depth == 0)
+    exempt_allocations += allocations - exemption_start;
+}
+
+static void* counted_allocate(std::size_t size) {
+  allocations++;
+  if (size == 0)
+    size = 1;
+
+  void* pointer = std::malloc(size);
+  if (!pointer)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void* operator new(std::size_t size) {
+  return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+  return counted_allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+#else
+bool allocation_counting_enabled() {
+  return false;
+}
+
+uint64_t thread_allocation_count() {
+  return 0;
+}
+
+AllocationExemption::AllocationExemption() {}
+AllocationExemption::~AllocationExemption() {}
+#endif
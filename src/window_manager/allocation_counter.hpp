@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+// counts heap allocations made by the calling thread, so the main loop can
+// tell when a frame that should be allocation free isnt. only does anything
+// when built with DOTE_COUNT_ALLOCATIONS, otherwise it always reads 0
+bool allocation_counting_enabled();
+uint64_t thread_allocation_count();
+
+// allocations made while one of these is alive dont show up in
+// thread_allocation_count(). for work that allocates on purpose and only
+// when something new turns up, like encoding an icon or growing a container
+// past the most it ever held
+class AllocationExemption {
+ public:
+  AllocationExemption();
+  ~AllocationExemption();
+
+  AllocationExemption(const AllocationExemption&) = delete;
+  AllocationExemption& operator=(const AllocationExemption&) = delete;
+};
@@ -0,0 +1,67 @@
+#include "atoms.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const struct {
+  const char* name;
+  WindowType type;
+} window_type_names[] = {
+    {"_NET_WM_WINDOW_TYPE_DESKTOP", WINDOW_TYPE_DESKTOP},
+    {"_NET_WM_WINDOW_TYPE_DOCK", WINDOW_TYPE_DOCK},
+    {"_NET_WM_WINDOW_TYPE_TOOLBAR", WINDOW_TYPE_TOOLBAR},
+    {"_NET_WM_WINDOW_TYPE_MENU", WINDOW_TYPE_MENU},
+    {"_NET_WM_WINDOW_TYPE_UTILITY", WINDOW_TYPE_UTILITY},
+    {"_NET_WM_WINDOW_TYPE_SPLASH", WINDOW_TYPE_SPLASH},
+    {"_NET_WM_WINDOW_TYPE_DIALOG", WINDOW_TYPE_DIALOG},
+    {"_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", WINDOW_TYPE_DROPDOWN_MENU},
+    {"_NET_WM_WINDOW_TYPE_POPUP_MENU", WINDOW_TYPE_POPUP_MENU},
+    {"_NET_WM_WINDOW_TYPE_TOOLTIP", WINDOW_TYPE_TOOLTIP},
+    {"_NET_WM_WINDOW_TYPE_NOTIFICATION", WINDOW_TYPE_NOTIFICATION},
+    {"_NET_WM_WINDOW_TYPE_COMBO", WINDOW_TYPE_COMBO},
+    {"_NET_WM_WINDOW_TYPE_DND", WINDOW_TYPE_DND},
+    {"_NET_WM_WINDOW_TYPE_NORMAL", WINDOW_TYPE_NORMAL},
+};
+
+bool AtomTable::intern(Display* display, int screen) {
+  std::string cm_selection = "_NET_WM_CM_S" + std::to_string(screen);
+
+  struct {
+    const char* name;
+    Atom* atom;
+  } named_atoms[] = {
+      {"_NET_WM_NAME", &net_wm_name},
+      {"UTF8_STRING", &utf8_string},
+      {"_NET_WM_WINDOW_TYPE", &net_wm_window_type},
+      {"_NET_WM_ICON", &net_wm_icon},
+      {"_NET_CLIENT_LIST", &net_client_list},
+      {"_NET_SUPPORTED", &net_supported},
+      {"_NET_SUPPORTING_WM_CHECK", &net_supporting_wm_check},
+      {cm_selection.c_str(), &net_wm_cm_s},
+  };
+
+  std::vector<char*> names;
+  for (auto& named : named_atoms) {
+    names.push_back((char*)named.name);
+  }
+  for (auto& window_type : window_type_names) {
+    names.push_back((char*)window_type.name);
+  }
+
+  std::vector<Atom> atoms(names.size());
+  if (!XInternAtoms(display, names.data(), names.size(), 0, atoms.data())) {
+    printf("interning atoms failed\n");
+    return false;
+  }
+
+  size_t i = 0;
+  for (auto& named : named_atoms) {
+    *named.atom = atoms[i++];
+  }
+  for (auto& window_type : window_type_names) {
+    window_types[atoms[i++]] = window_type.type;
+  }
+
+  return true;
+}
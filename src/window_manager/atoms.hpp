@@ -0,0 +1,41 @@
+#pragma once
+#include <X11/Xlib.h>
+
+#undef Status
+#undef Bool
+#undef True
+#undef False
+#undef None
+#undef Always
+#undef Success
+
+#include <unordered_map>
+#include "windowmanager.pb.h"
+
+// every atom the wm needs, interned in one XInternAtoms round trip when the
+// wm starts instead of one XInternAtom per use
+class AtomTable {
+ public:
+  bool intern(Display* display, int screen);
+
+  Atom net_wm_name;
+  Atom utf8_string;
+  Atom net_wm_window_type;
+  Atom net_wm_icon;
+
+  Atom net_client_list;
+  Atom net_supported;
+  Atom net_supporting_wm_check;
+  Atom net_wm_cm_s;  // compositing manager selection for our screen
+
+  // WINDOW_TYPE_NORMAL for anything we dont know about
+  WindowType window_type(Atom atom) const {
+    auto type = window_types.find(atom);
+    if (type == window_types.end())
+      return WINDOW_TYPE_NORMAL;
+    return type->second;
+  }
+
+ private:
+  std::unordered_map<Atom, WindowType> window_types;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <X11/X.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// how long clicks are held up before the client they were meant for gets
+// them. a press under a synchronous grab sits frozen until we XAllowEvents
+// it, everything else goes straight through.
+//
+// press times come from the server clock, which is milliseconds since the
+// server started. every timestamped event we read tells us roughly where
+// that clock is compared to ours, the quickest one is the best guess.
+class ClickLatency {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // any event with a server timestamp, the more the better
+  void observe(Time server_time, clock::time_point now) {
+    int64_t offset = local_ms(now) - (int64_t)server_time;
+    if (!offset_known || offset < offset_ms)
+      offset_ms = offset;
+    if (!interval_offset_known || offset < interval_offset_ms)
+      interval_offset_ms = offset;
+    offset_known = interval_offset_known = true;
+  }
+
+  void pressed() {
+    presses++;
+    report();
+  }
+
+  // a grabbed press that got let go at 'now'
+  void frozen(Time server_time, clock::time_point now) {
+    observe(server_time, now);
+
+    double ms = local_ms(now) - offset_ms - (int64_t)server_time;
+    if (ms < 0)
+      ms = 0;
+
+    size_t bucket = ms / bucket_width_ms;
+    if (bucket >= bucket_count)
+      bucket = bucket_count - 1;
+    buckets[bucket]++;
+
+    frozen_presses++;
+    total_ms += ms;
+    if (ms > max_ms)
+      max_ms = ms;
+  }
+
+ private:
+  static constexpr std::chrono::seconds report_interval{10};
+
+  // 1ms buckets up to 100ms, the server clock isnt any finer than that
+  static constexpr size_t bucket_count = 101;
+  static constexpr double bucket_width_ms = 1;
+
+  static int64_t local_ms(clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               time.time_since_epoch())
+        .count();
+  }
+
+  void report() {
+    auto now = clock::now();
+    if (now - last_report < report_interval)
+      return;
+    last_report = now;
+
+    // the two clocks drift apart, only trust what we saw recently
+    if (interval_offset_known)
+      offset_ms = interval_offset_ms;
+    interval_offset_known = false;
+
+    if (presses == 0)
+      return;
+
+    uint64_t p99_target = frozen_presses * 99 / 100;
+    double p99 = 0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+      uint64_t before = seen;
+      seen += buckets[i];
+      if (before <= p99_target && seen > p99_target)
+        p99 = (i + 1) * bucket_width_ms;
+      buckets[i] = 0;
+    }
+
+    printf(
+        "clicks: %lu presses, %lu frozen avg %.1fms p99 <%.0fms max %.0fms\n",
+        presses, frozen_presses,
+        frozen_presses ? total_ms / frozen_presses : 0.0, p99, max_ms);
+
+    presses = 0;
+    frozen_presses = 0;
+    total_ms = 0;
+    max_ms = 0;
+  }
+
+  bool offset_known = false;
+  int64_t offset_ms = 0;
+  bool interval_offset_known = false;
+  int64_t interval_offset_ms = 0;
+
+  uint64_t buckets[bucket_count] = {};
+  uint64_t presses = 0;
+  uint64_t frozen_presses = 0;
+  double total_ms = 0;
+  double max_ms = 0;
+
+  clock::time_point last_report = clock::now();
+};
@@ -0,0 +1,103 @@
+#include "event_loop.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+
+EventLoop::EventLoop() {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  // steady_clock is CLOCK_MONOTONIC, so deadlines can be passed straight in
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (!valid()) {
+    perror("event loop");
+    return;
+  }
+
+  watch(wake_fd, EVENT_SOURCE_WAKE);
+  watch(timer_fd, EVENT_SOURCE_TIMER);
+}
+
+EventLoop::~EventLoop() {
+  if (timer_fd >= 0)
+    close(timer_fd);
+  if (wake_fd >= 0)
+    close(wake_fd);
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+}
+
+void EventLoop::watch(int fd, EventSource source) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u32 = source;
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    perror("epoll_ctl");
+  }
+}
+
+void EventLoop::wake() {
+  uint64_t one = 1;
+  if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    perror("event loop wake");
+  }
+}
+
+void EventLoop::arm_timer(std::optional<clock::time_point> deadline) {
+  // all zeros disarms the timer
+  struct itimerspec spec = {};
+
+  if (deadline.has_value()) {
+    auto since_epoch = deadline->time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    auto nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch -
+                                                             seconds);
+
+    spec.it_value.tv_sec = seconds.count();
+    spec.it_value.tv_nsec = nanoseconds.count();
+
+    // a zero it_value would disarm instead of firing right away
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+      spec.it_value.tv_nsec = 1;
+  }
+
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+uint32_t EventLoop::wait(std::optional<clock::time_point> deadline) {
+  arm_timer(deadline);
+
+  constexpr int max_events = 8;
+  struct epoll_event events[max_events];
+
+  int count;
+  do {
+    count = epoll_wait(epoll_fd, events, max_events, -1);
+  } while (count < 0 && errno == EINTR);
+
+  uint32_t ready = 0;
+  for (int i = 0; i < count; i++) {
+    ready |= events[i].data.u32;
+  }
+
+  // reset the counters so they dont keep firing. EAGAIN just means someone
+  // else drained it first
+  uint64_t drain;
+  if (ready & EVENT_SOURCE_WAKE) {
+    if (read(wake_fd, &drain, sizeof(drain)) < 0 && errno != EAGAIN)
+      perror("event loop wake drain");
+  }
+  if (ready & EVENT_SOURCE_TIMER) {
+    if (read(timer_fd, &drain, sizeof(drain)) < 0 && errno != EAGAIN)
+      perror("event loop timer drain");
+  }
+
+  return ready;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// things the wm can be woken up by, wait() returns a mask of these
+enum EventSource : uint32_t {
+  EVENT_SOURCE_X = 1 << 0,
+  EVENT_SOURCE_INOTIFY = 1 << 1,
+  EVENT_SOURCE_WAKE = 1 << 2,   // another thread called wake()
+  EVENT_SOURCE_TIMER = 1 << 3,  // the frame deadline passed
+};
+
+// the one place the wm sleeps. everything it cares about is an fd in a
+// single epoll set so it wakes up the moment something arrives and not a
+// moment before
+class EventLoop {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  EventLoop();
+  ~EventLoop();
+
+  bool valid() const { return epoll_fd >= 0 && wake_fd >= 0 && timer_fd >= 0; }
+
+  void watch(int fd, EventSource source);
+
+  // safe to call from any thread
+  void wake();
+
+  // blocks until at least one source is ready or 'deadline' passes
+  uint32_t wait(std::optional<clock::time_point> deadline);
+
+ private:
+  void arm_timer(std::optional<clock::time_point> deadline);
+
+  int epoll_fd = -1;
+  int wake_fd = -1;
+  int timer_fd = -1;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+// scratch memory for things that only have to live until the end of the
+// current loop iteration, like serialized packets waiting for nn_send to copy
+// them. allocating is bumping a pointer and reset() hands it all back at
+// once, so a normal frame never touches the heap
+class FrameArena {
+ public:
+  explicit FrameArena(size_t size)
+      : buffer(std::make_unique<std::byte[]>(size)),
+        size(size),
+        resource(buffer.get(), size) {}
+
+  void* allocate(size_t bytes) {
+    used += bytes;
+    return resource.allocate(bytes, 1);
+  }
+
+  // whether 'bytes' more would still come out of the buffer
+  bool fits(size_t bytes) const { return used + bytes <= size; }
+
+  std::pmr::memory_resource* memory_resource() { return &resource; }
+
+  // anything that didnt fit in the buffer came from the heap, release()
+  // frees that too
+  void reset() {
+    resource.release();
+    used = 0;
+  }
+
+ private:
+  std::unique_ptr<std::byte[]> buffer;
+  size_t size;
+  size_t used = 0;
+  std::pmr::monotonic_buffer_resource resource;
+};
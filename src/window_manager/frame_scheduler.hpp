@@ -0,0 +1,232 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+
+#include "region.hpp"
+
+// tracks what on screen changed since the last frame so the compositor can
+// sleep instead of redrawing a static desktop, and only repaint the parts
+// that changed when it does draw.
+//
+// with vsync on it also keeps track of where vblank is, so a frame can be
+// started 'render_deadline' before the vblank it is meant for instead of
+// right away. that way it includes the latest input and window contents
+class FrameScheduler {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // something changed inside 'rect', in screen pixels
+  void damage(const Rect& rect) {
+    if (rect.empty())
+      return;
+
+    frame_damage = frame_damage.empty() ? rect : frame_damage.bounds(rect);
+    dirty = true;
+  }
+
+  // something changed that we cant put a rect on, repaint everything
+  void damage_all() {
+    full_damage = true;
+    dirty = true;
+  }
+
+  bool needs_frame() const { return dirty; }
+
+  // the area that has to be repainted into a back buffer that was last
+  // drawn 'buffer_age' frames ago, 0 meaning its contents are undefined
+  Rect repaint_region(int buffer_age, const Rect& screen) const {
+    if (full_damage || buffer_age <= 0 || buffer_age > damage_history_size)
+      return screen;
+
+    Rect region = frame_damage;
+    for (int i = 0; i < buffer_age - 1; i++) {
+      const Rect& old = history[(history_head + damage_history_size - 1 - i) %
+                                damage_history_size];
+      if (old.empty())
+        continue;
+      region = region.empty() ? old : region.bounds(old);
+    }
+
+    return region.intersect(screen);
+  }
+
+  // known refresh rate, from the driver or the monitor
+  void set_refresh_period(clock::duration period) {
+    refresh_period = period;
+    refresh_from_driver = true;
+  }
+
+  // how long before vblank composition should start
+  void set_render_deadline(clock::duration deadline) {
+    render_deadline = deadline;
+  }
+
+  void set_vsync(bool enabled) { vsync = enabled; }
+
+  // when the next frame should start being composited, this might be in the
+  // past when there is no vblank to line up with
+  clock::time_point frame_start(clock::time_point now) {
+    if (!vsync || !last_vblank.has_value()) {
+      target_vblank.reset();
+      return now;
+    }
+
+    // the target gets picked once, when the frame is first asked about.
+    // working it out again on every wakeup would push it a refresh further
+    // out each time and the frame would never start
+    if (!target_fixed) {
+      // first vblank we can still make with the deadline we were given
+      auto since = now + render_deadline - last_vblank.value();
+      auto periods = since / refresh_period + 1;
+      target_vblank = last_vblank.value() + periods * refresh_period;
+      target_fixed = true;
+    }
+
+    return target_vblank.value() - render_deadline;
+  }
+
+  // the driver says the latest vblank was at 'vblank'. if the last frame's
+  // swap still hasnt happened by then and that was well past the vblank it
+  // was aimed at, it missed
+  void vblank_seen(clock::time_point vblank, bool swap_pending) {
+    if (swap_pending && !target_fixed && target_vblank.has_value() &&
+        vblank > target_vblank.value() + refresh_period / 2) {
+      frames_missed++;
+      target_vblank.reset();
+    }
+
+    last_vblank = vblank;
+  }
+
+  // the pending frame already has its vblank picked
+  bool aimed() const { return target_fixed; }
+
+  // when the pending frame has to start rendering to make its vblank, work
+  // that runs before it shouldnt go past this. nothing if there is no frame
+  // pending or no vblank to aim at
+  std::optional<clock::time_point> render_by(clock::time_point now) {
+    if (!dirty || !vsync || !last_vblank.has_value())
+      return {};
+    return frame_start(now);
+  }
+
+  // the swap for the last frame completed at 'vblank'
+  void frame_presented(clock::time_point vblank) {
+    if (target_vblank.has_value() &&
+        vblank > target_vblank.value() + refresh_period / 2) {
+      frames_missed++;
+    }
+
+    if (last_vblank.has_value()) {
+      // when frames go back to back the distance between swaps is a good
+      // estimate of the refresh rate
+      auto delta = vblank - last_vblank.value();
+      auto periods = (delta + refresh_period / 2) / refresh_period;
+      if (!refresh_from_driver && periods >= 1 && periods <= 4) {
+        auto sample = delta / periods;
+        refresh_period = refresh_period * 9 / 10 + sample / 10;
+        refresh_measured = true;
+      }
+    }
+
+    last_vblank = vblank;
+  }
+
+  void frame_drawn(const Rect& screen) {
+    history[history_head] = full_damage ? screen : frame_damage;
+    history_head = (history_head + 1) % damage_history_size;
+
+    frame_damage = {};
+    full_damage = false;
+    dirty = false;
+    // frame_presented() still checks against target_vblank
+    target_fixed = false;
+
+    // the refresh this frame goes out in wasnt skipped
+    auto now = clock::now();
+    count_skipped(now - refresh_period);
+    skipped_since = now;
+
+    frames_drawn++;
+    report();
+  }
+
+  // the damage turned out to be nowhere on screen, forget about it
+  void discard() {
+    frame_damage = {};
+    full_damage = false;
+    dirty = false;
+    target_fixed = false;
+  }
+
+  // the loop is going to sleep without drawing. skipped refreshes are
+  // counted by time, not by how often this gets called
+  void idle(clock::time_point now) {
+    count_skipped(now - refresh_period);
+    report();
+  }
+
+  clock::duration period() const { return refresh_period; }
+
+  uint64_t drawn() const { return frames_drawn; }
+  uint64_t skipped() const { return frames_skipped; }
+  uint64_t missed() const { return frames_missed; }
+
+ private:
+  static constexpr std::chrono::seconds report_interval{10};
+
+  // every whole refresh period between the last frame and 'until' went by
+  // without one
+  void count_skipped(clock::time_point until) {
+    if (until <= skipped_since)
+      return;
+    auto periods = (until - skipped_since) / refresh_period;
+    frames_skipped += periods;
+    skipped_since += periods * refresh_period;
+  }
+
+  void report() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_report < report_interval)
+      return;
+    last_report = now;
+
+    printf("frames drawn %lu skipped %lu missed %lu, refresh %.2fms%s\n",
+           frames_drawn, frames_skipped, frames_missed,
+           std::chrono::duration<double, std::milli>(refresh_period).count(),
+           refresh_measured ? " (measured)" : "");
+  }
+
+  bool dirty = true;
+
+  // damage of the frame being built, as a bounding box
+  Rect frame_damage = {};
+  bool full_damage = true;
+
+  // damage of the last few presented frames, for buffer age
+  static constexpr int damage_history_size = 4;
+  Rect history[damage_history_size] = {};
+  int history_head = 0;
+
+  uint64_t frames_drawn = 0;
+  // refreshes without a frame, counted up to skipped_since
+  uint64_t frames_skipped = 0;
+  clock::time_point skipped_since = clock::now();
+  uint64_t frames_missed = 0;
+
+  bool vsync = false;
+  bool refresh_from_driver = false;
+  bool refresh_measured = false;
+  clock::duration refresh_period = std::chrono::microseconds(16667);
+  clock::duration render_deadline = std::chrono::microseconds(4000);
+
+  std::optional<clock::time_point> last_vblank;
+  std::optional<clock::time_point> target_vblank;
+  // target_vblank belongs to the frame being waited for
+  bool target_fixed = false;
+
+  std::chrono::steady_clock::time_point last_report =
+      std::chrono::steady_clock::now();
+};
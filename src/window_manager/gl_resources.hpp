@@ -0,0 +1,77 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// counts every pixmap, texture and buffer the wm creates so a leak shows up
+// in the log instead of as a slowly growing server. every per-window kind
+// that is alive should be held by some window, so any more live than the
+// windows hold means something didnt get freed
+class GLResources {
+ public:
+  enum Kind {
+    X_PIXMAP,
+    GLX_PIXMAP,
+    TEXTURE,
+    BUFFER,  // shared vaos and buffers, not owned by any window
+    KIND_COUNT,
+  };
+
+  void created(Kind kind) { live_count[kind]++; }
+  void freed(Kind kind) {
+    if (live_count[kind] == 0) {
+      printf("freed a %s that was never created\n", names[kind]);
+      return;
+    }
+    live_count[kind]--;
+  }
+
+  uint64_t live(Kind kind) const { return live_count[kind]; }
+
+  // how many per-window objects are alive that no window holds, 'owned' is
+  // how many of each kind the live windows have right now
+  uint64_t leaked(const uint64_t owned[BUFFER]) const {
+    uint64_t leaked = 0;
+    for (int kind = 0; kind < BUFFER; kind++) {
+      if (live_count[kind] > owned[kind])
+        leaked += live_count[kind] - owned[kind];
+    }
+    return leaked;
+  }
+
+  // true once every report interval, only then is it worth walking the
+  // windows for report()
+  bool report_due() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_report < report_interval)
+      return false;
+    last_report = now;
+    return true;
+  }
+
+  void report(size_t window_count, const uint64_t owned[BUFFER]) {
+    printf(
+        "gl resources for %zu windows: %lu x pixmaps, %lu glx pixmaps, "
+        "%lu textures, %lu buffers\n",
+        window_count, live_count[X_PIXMAP], live_count[GLX_PIXMAP],
+        live_count[TEXTURE], live_count[BUFFER]);
+
+    uint64_t leaked_count = leaked(owned);
+    if (leaked_count)
+      printf(
+          "WARNING %lu gl resources leaked (windows hold %lu x pixmaps, %lu "
+          "glx pixmaps, %lu textures)\n",
+          leaked_count, owned[X_PIXMAP], owned[GLX_PIXMAP], owned[TEXTURE]);
+  }
+
+ private:
+  static constexpr std::chrono::seconds report_interval{10};
+  static constexpr const char* names[KIND_COUNT] = {"x pixmap", "glx pixmap",
+                                                    "texture", "buffer"};
+
+  uint64_t live_count[KIND_COUNT] = {};
+
+  std::chrono::steady_clock::time_point last_report =
+      std::chrono::steady_clock::now();
+};
@@ -0,0 +1,83 @@
+#include "latency_probe.hpp"
+
+#include <X11/Xlib.h>
+#include <chrono>
+#include <cstdio>
+
+void LatencyProbe::start() {
+  if (thread.joinable())
+    return;
+
+  should_stop = false;
+  thread = std::thread([this]() { run(); });
+}
+
+void LatencyProbe::stop() {
+  should_stop = true;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void LatencyProbe::run() {
+  Display* display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    printf("[latency probe] couldnt open display\n");
+    return;
+  }
+
+  auto last_report = std::chrono::steady_clock::now();
+
+  while (!should_stop) {
+    auto start = std::chrono::steady_clock::now();
+    XSync(display, 0);
+    auto end = std::chrono::steady_clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    size_t bucket = ms / bucket_width_ms;
+    if (bucket >= bucket_count)
+      bucket = bucket_count - 1;
+    buckets[bucket]++;
+
+    samples++;
+    total_ms += ms;
+    if (ms > max_ms)
+      max_ms = ms;
+
+    if (end - last_report > std::chrono::seconds(10)) {
+      report();
+      last_report = end;
+    }
+
+    // roughly what a busy client does, we dont want to flood the server
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  report();
+  XCloseDisplay(display);
+}
+
+void LatencyProbe::report() {
+  if (samples == 0)
+    return;
+
+  uint64_t p50_target = samples / 2;
+  uint64_t p99_target = samples * 99 / 100;
+  double p50 = 0, p99 = 0;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count; i++) {
+    uint64_t before = seen;
+    seen += buckets[i];
+    if (before <= p50_target && seen > p50_target)
+      p50 = (i + 1) * bucket_width_ms;
+    if (before <= p99_target && seen > p99_target)
+      p99 = (i + 1) * bucket_width_ms;
+  }
+
+  printf(
+      "[latency probe] %s: %lu round trips avg %.3fms p50 <%.1fms p99 <%.1fms "
+      "max %.3fms\n",
+      label.c_str(), samples, total_ms / samples, p50, p99, max_ms);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// benchmark helper, acts like a normal x client on its own connection and
+// measures how long a round trip to the server takes while the wm is running.
+// any time the wm holds the server grabbed shows up here as latency
+class LatencyProbe {
+ public:
+  explicit LatencyProbe(std::string label) : label(std::move(label)) {}
+  ~LatencyProbe() { stop(); }
+
+  void start();
+  void stop();
+
+ private:
+  void run();
+  void report();
+
+  std::string label;
+  std::thread thread;
+  std::atomic<bool> should_stop{false};
+
+  // 0.1ms buckets up to 100ms, last bucket catches everything slower
+  static constexpr size_t bucket_count = 1001;
+  static constexpr double bucket_width_ms = 0.1;
+  uint64_t buckets[bucket_count] = {};
+
+  uint64_t samples = 0;
+  double total_ms = 0;
+  double max_ms = 0;
+};
@@ -8,6 +8,7 @@
 #include <X11/Xutil.h>
 #include <X11/extensions/XInput2.h>
 #include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xfixes.h>
 #include <X11/extensions/shape.h>
 #include <libgen.h>
@@ -134,6 +135,8 @@ void gl_set_vao_vbo_ibo_data(GLuint vao,
     fprintf(stderr, "WARNING Cannot get FBConfig attribute " #attr "\n"); \
   }
 
+static XRequestLog request_log;
+
 int x11_error_handler(Display* display, XErrorEvent* event) {
   if (!event->resourceid)
     return 0;  // invalid window
@@ -141,12 +144,24 @@ int x11_error_handler(Display* display, XErrorEvent* event) {
   char buffer[1024];
   XGetErrorText(display, event->error_code, buffer, sizeof(buffer));
 
-  printf("XError code = %d, string = %s, resource ID = 0x%lx\n",
-         event->error_code, buffer, event->resourceid);
+  printf("XError code = %d, string = %s, resource ID = 0x%lx, serial = %lu\n",
+         event->error_code, buffer, event->resourceid, event->serial);
+
+  const XRequestLog::Entry* cause = request_log.find(event->serial);
+  if (cause != nullptr) {
+    printf("  %s %s on 0x%lx (serial %lu)\n",
+           cause->serial == event->serial ? "caused by" : "somewhere after",
+           cause->request, cause->resource, cause->serial);
+  }
 
   return 0;
 }
 
+void DoteWindowManager::track_request(const char* request,
+                                      unsigned long resource) {
+  request_log.record(NextRequest(display), request, resource);
+}
+
 void DoteWindowManager::configure_window(Window window,
                                          uint32_t x,
                                          uint32_t y,
@@ -157,6 +172,7 @@ void DoteWindowManager::configure_window(Window window,
   changes.y = y;
   changes.width = width;
   changes.height = height;
+  track_request("XConfigureWindow", window);
   XConfigureWindow(display, window, CWX | CWY | CWWidth | CWHeight, &changes);
 }
 
@@ -165,23 +181,35 @@ void DoteWindowManager::register_border(Window window,
                                         int32_t y,
                                         int32_t width,
                                         int32_t height) {
-  if (windows.find(window) == windows.end())
+  DoteWindow* dote_window = windows.find(window);
+  if (!dote_window)
     return;
 
-  windows[window].border = {
+  damage_window(dote_window);
+
+  dote_window->border = {
       .x = x,
       .y = y,
       .width = width,
       .height = height,
   };
+
+  damage_window(dote_window);
+  index_window(dote_window);
 }
 
 void DoteWindowManager::register_base_window(Window base) {
   base_window = base;
 
+  // the browser never gets focused by us, so a grab there only ever holds
+  // clicks back. with raw events the browser hears about them anyway
+  if (click_mode == ClickMode::RAW)
+    ungrab_clicks(base);
+
   XWMHints hints;
   hints.flags = InputHint;
   hints.input = false;
+  track_request("XSetWMHints", base);
   XSetWMHints(display, base, &hints);
 
   XWindowChanges changes;
@@ -190,68 +218,211 @@ void DoteWindowManager::register_base_window(Window base) {
   changes.width = screen_width;
   changes.height = screen_height;
   changes.stack_mode = Below;
+  track_request("XConfigureWindow", base);
   XConfigureWindow(display, base, CWX | CWY | CWWidth | CWHeight | CWStackMode,
                    &changes);
   printf("registering\n");
 }
 
-void DoteWindowManager::bind_window_texture(Window window_index) {
-  DoteWindow* window = &windows[window_index];
-
+void DoteWindowManager::update_window_texture(DoteWindow* window) {
   if (!window->exists)
     return;
   if (!window->visible)
     return;
 
-  // TODO 'XGrabServer'/'XUngrabServer' necessary?
-  // it seems to make things 10x faster for whatever reason
-  // which is actually good for recording using OBS with XSHM
+  if (!window->texture) {
+    glGenTextures(1, &window->texture);
+    resources.created(GLResources::TEXTURE);
+    glBindTexture(GL_TEXTURE_2D, window->texture);
 
-  XGrabServer(display);
-  // glXWaitX(); // same as 'XSync', but a tad more efficient
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  // update the window's pixmap
-
-  if (!window->pixmap) {
-    XWindowAttributes attribs;
-    XGetWindowAttributes(display, window->window, &attribs);
-
-    int format;
-    GLXFBConfig config;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
 
-    for (int i = 0; i < glx_config_count; i++) {
-      config = glx_configs[i];
+  if (!window_texture_stale(window))
+    return;
 
-      int has_alpha;
-      glXGetFBConfigAttribChecked(display, config, GLX_BIND_TO_TEXTURE_RGBA_EXT,
-                                  &has_alpha);
+  // work out how to name the pixmap before grabbing anything
+  const PixmapFormat* format = nullptr;
+  if (!window->pixmap) {
+    // the depth of a window never changes, ask once
+    if (!window->bit_depth) {
+      XWindowAttributes attribs;
+      track_request("XGetWindowAttributes", window->window);
+      if (!XGetWindowAttributes(display, window->window, &attribs))
+        return;
+      window->bit_depth = attribs.depth;
+    }
 
-      XVisualInfo* visual = glXGetVisualFromFBConfig(display, config);
-      int visual_depth = visual->depth;
-      free(visual);
+    auto found = pixmap_formats.find(window->bit_depth);
+    if (found == pixmap_formats.end()) {
+      printf("no fbconfig for %i bit window %lu\n", window->bit_depth,
+             window->window);
+      return;
+    }
+    format = &found->second;
+  }
 
-      if (attribs.depth != visual_depth) {
-        continue;
-      }
+  // the old behaviour, grabbing here freezes every other client for each
+  // window we refresh
+  if (grab_mode == GrabMode::WINDOW)
+    XGrabServer(display);
 
-      // found the config we want, break
+  // update the window's pixmap
 
-      format =
-          has_alpha ? GLX_TEXTURE_FORMAT_RGBA_EXT : GLX_TEXTURE_FORMAT_RGB_EXT;
-      break;
-    }
+  if (!window->pixmap) {
+    GLXFBConfig config = format->config;
 
     const int pixmap_attributes[] = {
         GLX_TEXTURE_TARGET_EXT, GLX_TEXTURE_2D_EXT, GLX_TEXTURE_FORMAT_EXT,
-        format, 0  // GLX_TEXTURE_FORMAT_RGB_EXT
+        format->texture_format, 0  // GLX_TEXTURE_FORMAT_RGB_EXT
     };
 
+    // 24 bit windows have nothing useful in their alpha channel
+    window->has_alpha = window->bit_depth == 32;
+
+    track_request("XCompositeNameWindowPixmap", window->window);
     window->x_pixmap = XCompositeNameWindowPixmap(display, window->window);
+    track_request("glXCreatePixmap", window->x_pixmap);
     window->pixmap =
         glXCreatePixmap(display, config, window->x_pixmap, pixmap_attributes);
+    if (window->x_pixmap)
+      resources.created(GLResources::X_PIXMAP);
+    if (window->pixmap)
+      resources.created(GLResources::GLX_PIXMAP);
+
+    window->pixmap_width = window->width;
+    window->pixmap_height = window->height;
+    window->pixmap_generation = window->map_generation;
   }
 
+  // anything damaged from here on shows up as a new notify. the bounding box
+  // only gets reported when it grows, so whatever piled up while the window
+  // wasnt being refreshed has to go every time, not just after a notify
+  track_request("XDamageSubtract", window->damage);
+  XDamageSubtract(display, window->damage, 0, 0);
+  window->damaged = false;
+
+  glBindTexture(GL_TEXTURE_2D, window->texture);
+  if (window->texture_bound) {
+    glXReleaseTexImageEXT(display, window->pixmap, GLX_FRONT_LEFT_EXT);
+  }
   glXBindTexImageEXT(display, window->pixmap, GLX_FRONT_LEFT_EXT, NULL);
+  window->texture_bound = true;
+
+  // send the ungrab now, buffered it would hold the server until the frame
+  // is rendered and flushed
+  if (grab_mode == GrabMode::WINDOW) {
+    XUngrabServer(display);
+    XFlush(display);
+  }
+}
+
+void DoteWindowManager::build_pixmap_formats() {
+  for (int i = 0; i < glx_config_count; i++) {
+    GLXFBConfig config = glx_configs[i];
+
+    XVisualInfo* visual = glXGetVisualFromFBConfig(display, config);
+    if (!visual)
+      continue;
+    int visual_depth = visual->depth;
+    XFree(visual);
+
+    // first config wins, same as the search this replaces
+    if (pixmap_formats.find(visual_depth) != pixmap_formats.end())
+      continue;
+
+    int has_alpha = 0;
+    glXGetFBConfigAttribChecked(display, config, GLX_BIND_TO_TEXTURE_RGBA_EXT,
+                                &has_alpha);
+
+    pixmap_formats[visual_depth] = {
+        .config = config,
+        .texture_format =
+            has_alpha ? GLX_TEXTURE_FORMAT_RGBA_EXT : GLX_TEXTURE_FORMAT_RGB_EXT,
+    };
+    printf("%i bit windows use fbconfig %i\n", visual_depth, i);
+  }
+}
+
+bool DoteWindowManager::window_texture_stale(DoteWindow* window) {
+  if (!window->exists || !window->visible)
+    return false;
+
+  // the texture stays bound to the pixmap between frames, only rebind when
+  // the contents changed or the pixmap was recreated
+  return !window->texture_bound || window->damaged;
+}
+
+void DoteWindowManager::refresh_textures() {
+  bool synced = false;
+
+  for (auto& window : windows) {
+    if (!synced && window_texture_stale(&window)) {
+      if (grab_mode == GrabMode::FRAME) {
+        // one grab covering every refresh this frame
+        XGrabServer(display);
+      } else if (grab_mode == GrabMode::NONE) {
+        // make sure the server finished the rendering that caused the damage
+        glXWaitX();
+      }
+      synced = true;
+    }
+
+    update_window_texture(&window);
+  }
+
+  // send the ungrab now, buffered it would hold the server through the
+  // whole render
+  if (synced && grab_mode == GrabMode::FRAME) {
+    XUngrabServer(display);
+    XFlush(display);
+  }
+}
+
+bool DoteWindowManager::window_pixmap_stale(DoteWindow* window) {
+  if (!window->pixmap)
+    return false;
+
+  // the server hands out a new pixmap whenever the window gets resized or
+  // mapped again, a move or restack keeps the old one valid
+  return !window->visible || window->width != window->pixmap_width ||
+         window->height != window->pixmap_height ||
+         window->map_generation != window->pixmap_generation;
+}
+
+void DoteWindowManager::destroy_window_pixmap(DoteWindow* window) {
+  if (window->texture_bound) {
+    glBindTexture(GL_TEXTURE_2D, window->texture);
+    glXReleaseTexImageEXT(display, window->pixmap, GLX_FRONT_LEFT_EXT);
+    window->texture_bound = false;
+  }
+
+  if (window->pixmap) {
+    glXDestroyPixmap(display, window->pixmap);
+    window->pixmap = 0;
+    resources.freed(GLResources::GLX_PIXMAP);
+  }
+
+  if (window->x_pixmap) {
+    track_request("XFreePixmap", window->x_pixmap);
+    XFreePixmap(display, window->x_pixmap);
+    window->x_pixmap = 0;
+    resources.freed(GLResources::X_PIXMAP);
+  }
+}
+
+void DoteWindowManager::release_window(DoteWindow* window) {
+  destroy_window_pixmap(window);
+
+  if (window->texture) {
+    glDeleteTextures(1, &window->texture);
+    window->texture = 0;
+    resources.freed(GLResources::TEXTURE);
+  }
 }
 
 void DoteWindowManager::run() {
@@ -260,25 +431,256 @@ void DoteWindowManager::run() {
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+  uint32_t ready = 0;
+  uint64_t loop_allocations = thread_allocation_count();
   while (true) {
-    while (process_events())
-      ;
+    // whatever the frame we just drew had for the browser
+    flush_outgoing();
+
+    // everything the last time round did, events and ipc included
+    if (allocation_counting_enabled()) {
+      uint64_t allocations = thread_allocation_count();
+      check_loop_allocations(allocations - loop_allocations);
+      loop_allocations = allocations;
+    }
+
+    // whatever got serialized last time round has been sent by now
+    frame_arena.reset();
+    if (!outgoing)
+      packet_arena.Reset();
+
+    // every kind of work gets a slice of time, whatever doesnt fit waits
+    // until after the next frame. a slice also ends early when a frame is
+    // due to start rendering, so a burst cant make it miss its vblank. with
+    // OML the phase has to be fresh for that
+    if (vsync && vblank_source == VblankSource::OML && scheduler.needs_frame())
+      sync_vblank();
+    x_budget.start(scheduler.render_by(FrameScheduler::clock::now()));
+    while (XPending(display) && x_budget.allow())
+      process_events();
+    x_budget.stop();
+
+    forward_pointer();
+    if (ready & EVENT_SOURCE_INOTIFY)
+      inotify_step();
+
+    ipc_budget.start(scheduler.render_by(FrameScheduler::clock::now()));
+    ipc_step();
+    ipc_budget.stop();
+
+    background_step();
+
+    // requests are batched up now, this sends whatever the events and ipc
+    // packets we just handled asked for
+    XFlush(display);
+
+    if (resources.report_due()) {
+      uint64_t owned[GLResources::BUFFER] = {};
+      for (auto& window : windows) {
+        owned[GLResources::X_PIXMAP] += window.x_pixmap != 0;
+        owned[GLResources::GLX_PIXMAP] += window.pixmap != 0;
+        owned[GLResources::TEXTURE] += window.texture != 0;
+      }
+      resources.report(windows.size(), owned);
+    }
+
+    if (!scheduler.needs_frame() && pending_updates.empty()) {
+      // nothing changed, dont touch the gpu until something does
+      scheduler.idle(FrameScheduler::clock::now());
+      ready = wait_for_work({});
+      continue;
+    }
+
+    // hold off until just before the vblank this frame is meant for, anything
+    // that comes in meanwhile still makes it into the frame
+    if (vsync && vblank_source == VblankSource::OML)
+      sync_vblank();
+
+    auto now = FrameScheduler::clock::now();
+    auto frame_start = scheduler.frame_start(now);
+    if (frame_start > now) {
+      ready = wait_for_work(frame_start);
+      continue;
+    }
+    ready = 0;
+
+    // however many wakeups the events came in over, each changed window gets
+    // one browser update and one pixmap check per frame
+    flush_window_updates();
+    XFlush(display);
+
+    // only a property changed, nothing to redraw
+    if (!scheduler.needs_frame()) {
+      scheduler.discard();
+      continue;
+    }
+
+    Rect screen = {0, 0, (int)screen_width, (int)screen_height};
+
+    int buffer_age = 0;
+    if (present_mode == PresentMode::BUFFER_AGE) {
+      unsigned int age = 0;
+      glXQueryDrawable(display, output_window, GLX_BACK_BUFFER_AGE_EXT, &age);
+      buffer_age = age;
+    } else if (present_mode == PresentMode::COPY_SUB_BUFFER) {
+      // we never swap, so the back buffer always holds the last frame
+      buffer_age = 1;
+    }
+
+    Rect repaint = scheduler.repaint_region(buffer_age, screen);
+    if (repaint.empty()) {
+      scheduler.discard();
+      continue;
+    }
+
+    // everything from the clear to the draws only touches the repaint area
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(repaint.x, screen_height - repaint.y - repaint.height,
+              repaint.width, repaint.height);
+
     glClearColor(1, 1, 1, 1);
     glClearDepth(1.2);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    ipc_step();
-    for (auto window : windows) {
-      render_window(window.second.window);
-    }
+    refresh_textures();
+
+    render_windows(repaint);
+
+    glDisable(GL_SCISSOR_TEST);
 
-    glXSwapBuffers(display, output_window);
+    present(repaint);
+    XFlush(display);
+    scheduler.frame_drawn(screen);
+
+    // dont wait for the swap, when it happened comes from sync_vblank() or
+    // a swap event later on
+    if (present_mode != PresentMode::COPY_SUB_BUFFER)
+      swaps_queued++;
+  }
+}
+
+// ust is CLOCK_MONOTONIC in microseconds on mesa, same clock as steady_clock
+static FrameScheduler::clock::time_point ust_time(int64_t ust) {
+  return FrameScheduler::clock::time_point(std::chrono::microseconds(ust));
+}
+
+void DoteWindowManager::sync_vblank() {
+  // its a round trip, only worth it while the next frame is still being
+  // lined up
+  if (scheduler.aimed())
+    return;
+
+  int64_t ust, msc, sbc;
+  if (!glXGetSyncValuesOML(display, output_window, &ust, &msc, &sbc) ||
+      ust == 0)
+    return;
+
+  scheduler.vblank_seen(ust_time(ust), sbc < swaps_queued);
+}
+
+void DoteWindowManager::check_loop_allocations(uint64_t allocations) {
+  // the first few frames grow everything to its working size, after that
+  // anything new gets room made for it under an AllocationExemption
+  constexpr uint64_t warmup_frames = 60;
+
+  if (allocations == 0 || scheduler.drawn() < warmup_frames)
+    return;
+
+  printf("loop iteration after frame %lu allocated %lu times\n",
+         scheduler.drawn(), allocations);
+  abort();
+}
+
+void DoteWindowManager::reserve_frame_scratch() {
+  // a window can be queued twice, once more for its border
+  size_t items = windows.size() * 2;
+  draw_items.reserve(items);
+  occluders.reserve(items);
+  instances.reserve(items);
+  instance_textures.reserve(items);
+  instance_batches.reserve(items);
+  pending_updates.reserve(windows.size());
+}
+
+void DoteWindowManager::present(const Rect& repaint) {
+  if (present_mode == PresentMode::COPY_SUB_BUFFER) {
+    glXCopySubBufferMESA(display, output_window, repaint.x,
+                         screen_height - repaint.y - repaint.height,
+                         repaint.width, repaint.height);
+    glFlush();
+    return;
+  }
+
+  glXSwapBuffers(display, output_window);
+}
+
+Rect DoteWindowManager::window_rect(DoteWindow* window) {
+  return {window->x, window->y, window->width, window->height};
+}
+
+std::optional<Rect> DoteWindowManager::border_rect(DoteWindow* window) {
+  if (!window->border.has_value())
+    return {};
+
+  return Rect{
+      window->x + window->border->x,
+      window->y + window->border->y,
+      window->width - window->border->x + window->border->width,
+      window->height - window->border->y + window->border->height,
+  };
+}
+
+void DoteWindowManager::index_window(DoteWindow* window) {
+  if (!window->visible) {
+    spatial_index.remove(window->window);
+    return;
   }
+
+  Rect bounds = window_rect(window);
+  auto border = border_rect(window);
+  if (border.has_value())
+    bounds = bounds.bounds(border.value());
+
+  spatial_index.update(window->window, bounds);
 }
 
-void DoteWindowManager::render_window(unsigned window_id) {
-  DoteWindow* window = &windows[window_id];
+void DoteWindowManager::damage_window(DoteWindow* window) {
+  if (!window->visible)
+    return;
+
+  scheduler.damage(window_rect(window));
+
+  auto border = border_rect(window);
+  if (border.has_value())
+    scheduler.damage(border.value());
+}
 
+uint32_t DoteWindowManager::wait_for_work(
+    std::optional<FrameScheduler::clock::time_point> deadline) {
+  // dont keep the browser waiting while we sleep
+  flush_outgoing();
+  XFlush(display);
+
+  // xlib might already have events sitting in its queue which epoll wont see
+  if (XPending(display))
+    return EVENT_SOURCE_X;
+
+  // left over from a slice that ran out of time, the fds wont fire again
+  // for it
+  if (ipc_backlog() || !pending_icons.empty())
+    return EVENT_SOURCE_WAKE;
+
+  // the pointer moved too soon after the last forward, come back for it
+  if (pointer_moved) {
+    auto due = last_pointer_query + pointer_period();
+    if (!deadline.has_value() || due < deadline.value())
+      deadline = due;
+  }
+
+  return event_loop.wait(deadline);
+}
+
+void DoteWindowManager::queue_window(DoteWindow* window) {
   if (!window->exists)
     return;
   if (!window->visible)
@@ -305,29 +707,12 @@ void DoteWindowManager::render_window(unsigned window_id) {
     depth = 0.9;
   }
 
-  glUseProgram(shader);
-  glUniform1i(texture_uniform, 0);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-  if (window->border.has_value() && base_window.has_value() &&
-      windows.find(base_window.value()) != windows.end()) {
-    glActiveTexture(GL_TEXTURE0);
-
-    bind_window_texture(windows[base_window.value()].window);
-
-    glUniform1f(opacity_uniform, 1);
-    glUniform1f(depth_uniform, window->depth + 0.0001);
-
-    glUniform2f(position_uniform, x_coordinate_to_float(screen_width / 2),
-                y_coordinate_to_float(screen_height / 2));
-    glUniform2f(size_uniform, width_dimension_to_float(screen_width),
-                height_dimension_to_float(screen_height));
+  DoteWindow* base =
+      base_window.has_value() ? windows.find(base_window.value()) : nullptr;
 
+  if (window->border.has_value() && base && base->texture_bound) {
+    // the border is a cutout of the base window, so it samples the whole
+    // screen sized base texture but only draws the border rect
     uint32_t pixel_border_width =
         window->width - window->border->x + window->border->width;
     uint32_t pixel_border_height =
@@ -339,31 +724,186 @@ void DoteWindowManager::render_window(unsigned window_id) {
     float border_width = width_dimension_to_float(pixel_border_width);
     float border_height = height_dimension_to_float(pixel_border_height);
 
-    glUniform2f(cropped_position_uniform, border_x, border_y);
-    glUniform2f(cropped_size_uniform, border_width, border_height);
+    draw_items.push_back({
+        .instance =
+            {
+                .position = {x_coordinate_to_float(screen_width / 2),
+                             y_coordinate_to_float(screen_height / 2)},
+                .size = {width_dimension_to_float(screen_width),
+                         height_dimension_to_float(screen_height)},
+                .cropped_position = {border_x, border_y},
+                .cropped_size = {border_width, border_height},
+                .depth = (float)(window->depth + 0.0001),
+                .opacity = 1,
+            },
+        .texture = base->texture,
+        .rect = border_rect(window).value(),
+        .opaque = !base->has_alpha,
+        .order = (uint32_t)draw_items.size(),
+    });
+  }
+
+  if (!window->texture_bound)
+    return;
+
+  draw_items.push_back({
+      .instance =
+          {
+              .position = {gl_x, gl_y},
+              .size = {gl_width, gl_height},
+              .cropped_position = {gl_x, gl_y},
+              .cropped_size = {gl_width, gl_height},
+              .depth = depth,
+              .opacity = window->opacity,
+          },
+      .texture = window->texture,
+      .rect = window_rect(window),
+      .opaque = !window->has_alpha && window->opacity >= 1,
+      .order = (uint32_t)draw_items.size(),
+  });
+}
+
+void DoteWindowManager::set_instance_attributes(size_t first) {
+  glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+
+  size_t offset = first * sizeof(WindowInstance);
+  glVertexAttribPointer(
+      1, 4, GL_FLOAT, GL_FALSE, sizeof(WindowInstance),
+      (void*)(offset + offsetof(WindowInstance, position)));
+  glVertexAttribPointer(
+      2, 4, GL_FLOAT, GL_FALSE, sizeof(WindowInstance),
+      (void*)(offset + offsetof(WindowInstance, cropped_position)));
+  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(WindowInstance),
+                        (void*)(offset + offsetof(WindowInstance, depth)));
+  glVertexAttribIPointer(4, 1, GL_INT, sizeof(WindowInstance),
+                         (void*)(offset + offsetof(WindowInstance, slot)));
+}
+
+void DoteWindowManager::batch_instances(size_t first,
+                                        size_t end,
+                                        bool blend) {
+  if (first == end)
+    return;
+
+  // split the instances into batches that each fit in the texture units we
+  // have, most of the time everything ends up in a single batch
+  instance_batches.push_back({.first = first, .blend = blend});
+  for (size_t i = first; i < end; i++) {
+    InstanceBatch* batch = &instance_batches.back();
+
+    int slot = -1;
+    for (int j = 0; j < batch->texture_count; j++) {
+      if (batch->textures[j] == instance_textures[i]) {
+        slot = j;
+        break;
+      }
+    }
+
+    if (slot == -1) {
+      if (batch->texture_count == BATCH_TEXTURE_UNITS) {
+        instance_batches.push_back({.first = i, .blend = blend});
+        batch = &instance_batches.back();
+      }
+      slot = batch->texture_count++;
+      batch->textures[slot] = instance_textures[i];
+    }
+
+    instances[i].slot = slot;
+    batch->count++;
+  }
+}
+
+void DoteWindowManager::render_windows(const Rect& repaint) {
+  draw_items.clear();
+  instances.clear();
+  instance_textures.clear();
+  instance_batches.clear();
+
+  // bottom to top, so the depth sort below has little left to do
+  windows.restack([](const DoteWindow& a, const DoteWindow& b) {
+    return a.depth > b.depth;
+  });
+  for (auto& window : windows) {
+    queue_window(&window);
+  }
+
+  if (draw_items.empty())
+    return;
 
-    glBindVertexArray(window->vao);
-    glDrawElements(GL_TRIANGLES, window->index_count, GL_UNSIGNED_BYTE, NULL);
+  // smaller depth is closer to the viewer. stable_sort would allocate a
+  // temporary buffer every frame, queue order breaks ties instead
+  std::sort(draw_items.begin(), draw_items.end(),
+            [](const DrawItem& a, const DrawItem& b) {
+              if (a.instance.depth != b.instance.depth)
+                return a.instance.depth < b.instance.depth;
+              return a.order < b.order;
+            });
+
+  // visibility pass, front to back. anything hidden behind opaque windows
+  // never gets sampled
+  occluders.clear();
+  for (auto& item : draw_items) {
+    // outside the scissor, it can neither show up nor hide anything
+    if (!item.rect.overlaps(repaint)) {
+      item.visible = false;
+      continue;
+    }
+
+    item.visible =
+        !rect_covered(item.rect, occluders, occlusion_scratch,
+                      occlusion_scratch2);
+    if (item.visible && item.opaque)
+      occluders.push_back(item.rect);
+  }
+
+  // opaque windows front to back so the depth test throws away as much as
+  // possible, then translucent ones back to front on top
+  for (auto& item : draw_items) {
+    if (!item.visible || !item.opaque)
+      continue;
+    instances.push_back(item.instance);
+    instance_textures.push_back(item.texture);
+  }
+  size_t opaque_count = instances.size();
 
-    unbind_window_texture(windows[base_window.value()].window);
+  for (auto item = draw_items.rbegin(); item != draw_items.rend(); item++) {
+    if (!item->visible || item->opaque)
+      continue;
+    instances.push_back(item->instance);
+    instance_textures.push_back(item->texture);
   }
 
-  glActiveTexture(GL_TEXTURE0);
-  bind_window_texture(window->window);
+  batch_instances(0, opaque_count, false);
+  batch_instances(opaque_count, instances.size(), true);
 
-  glUniform1f(opacity_uniform, 1);
-  glUniform1f(depth_uniform, depth);
+  glUseProgram(shader);
+  glBindVertexArray(quad_vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+  glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(WindowInstance),
+               instances.data(), GL_STREAM_DRAW);
 
-  glUniform2f(position_uniform, gl_x, gl_y);
-  glUniform2f(size_uniform, gl_width, gl_height);
+  for (auto& batch : instance_batches) {
+    if (batch.blend) {
+      glEnable(GL_BLEND);
+      glDepthMask(GL_FALSE);
+    } else {
+      glDisable(GL_BLEND);
+      glDepthMask(GL_TRUE);
+    }
 
-  glUniform2f(cropped_position_uniform, gl_x, gl_y);
-  glUniform2f(cropped_size_uniform, gl_width, gl_height);
+    for (int i = 0; i < batch.texture_count; i++) {
+      glActiveTexture(GL_TEXTURE0 + i);
+      glBindTexture(GL_TEXTURE_2D, batch.textures[i]);
+    }
 
-  glBindVertexArray(window->vao);
-  glDrawElements(GL_TRIANGLES, window->index_count, GL_UNSIGNED_BYTE, NULL);
+    set_instance_attributes(batch.first);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, NULL,
+                            batch.count);
+  }
 
-  unbind_window_texture(window->window);
+  // glClear respects the depth mask
+  glDepthMask(GL_TRUE);
 }
 
 bool DoteWindowManager::process_events() {
@@ -377,29 +917,67 @@ bool DoteWindowManager::process_events() {
         event.xcookie.extension != xi_opcode) {
       int type = event.type;
 
-      if (type == CreateNotify) {
+      if (type == damage_event_base + XDamageNotify) {
+        XDamageNotifyEvent* damage_event = (XDamageNotifyEvent*)&event;
+
+        DoteWindow* window = windows.find(damage_event->drawable);
+        if (!window)
+          goto done;
+
+        // area is the bounding box of everything damaged since the last
+        // subtract, which happens when we rebind the texture
+        window->damaged = true;
+        if (window->visible) {
+          scheduler.damage({window->x + damage_event->area.x,
+                            window->y + damage_event->area.y,
+                            damage_event->area.width,
+                            damage_event->area.height});
+        }
+      } else if (vblank_source == VblankSource::SWAP_EVENT &&
+                 type == glx_event_base + GLX_BufferSwapComplete) {
+        GLXBufferSwapComplete* swap_event = (GLXBufferSwapComplete*)&event;
+        scheduler.frame_presented(ust_time(swap_event->ust));
+      } else if (type == CreateNotify) {
         Window x_window = event.xcreatewindow.window;
-        if (std::find(blacklisted_windows.begin(), blacklisted_windows.end(),
-                      x_window) != blacklisted_windows.end())
+        if (windows.blacklisted(x_window))
           goto done;
 
-        windows[x_window] = {};
-        DoteWindow* window = &windows[x_window];
+        // an id we still have something for, dont leak what it owned
+        if (DoteWindow* old_window = windows.find(x_window))
+          release_window(old_window);
+
+        // the registry and the per frame vectors grow to fit one more
+        AllocationExemption exemption;
+        DoteWindow* window = windows.insert(x_window);
+        reserve_frame_scratch();
 
         window->exists = 1;
         window->window = x_window;
 
         window->opacity = 1.0;
-        gl_create_vao_vbo_ibo(&window->vao, &window->vbo, &window->ibo);
+
+        // from here on the geometry comes out of the configure events
+        window->x = event.xcreatewindow.x;
+        window->y = event.xcreatewindow.y;
+        window->width = event.xcreatewindow.width;
+        window->height = event.xcreatewindow.height;
+        window->visible = 0;
+
+        track_request("XDamageCreate", x_window);
+        // the server frees this for us when the window is destroyed
+        window->damage =
+            XDamageCreate(display, x_window, XDamageReportBoundingBox);
+        window->damaged = true;
 
         // set up some other stuff for the window
         // this is saying we want focus change and button events from the
         // window
 
-        XSelectInput(display, x_window, FocusChangeMask | PointerMotionMask);
-        XGrabButton(display, AnyButton, AnyModifier, x_window, 1,
-                    ButtonPressMask | ButtonReleaseMask | ButtonMotionMask,
-                    GrabModeSync, GrabModeSync, 0, 0);
+        track_request("XSelectInput", x_window);
+        XSelectInput(display, x_window,
+                     FocusChangeMask | PointerMotionMask | PropertyChangeMask);
+        // nothing new starts out focused, so clicking it has to go through us
+        grab_clicks(x_window);
 
         update_client_list();
         printf("created a window!\n");
@@ -419,265 +997,97 @@ bool DoteWindowManager::process_events() {
         else if (type == UnmapNotify)
           x_window = event.xunmap.window;
 
-        if (std::find(blacklisted_windows.begin(), blacklisted_windows.end(),
-                      x_window) != blacklisted_windows.end())
+        if (windows.blacklisted(x_window))
           goto done;
 
-        if (windows.find(x_window) == windows.end())
+        DoteWindow* window = windows.find(x_window);
+        if (!window)
           goto done;
-
-        DoteWindow* window = &windows[x_window];
-
-        window->window = x_window;
-
-        // copy everything from the map
-        XWindowAttributes attributes;
-
-        XGetWindowAttributes(display, window->window, &attributes);
-
-        window->visible = attributes.map_state == IsViewable;
-
-        window->x = attributes.x;
-        window->y = attributes.y;
-
-        window->depth = 0.1;
-
-        window->width = attributes.width;
-        window->height = attributes.height;
-
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char* prop = nullptr;
-        Atom net_wm_name = XInternAtom(display, "_NET_WM_NAME", false);
-        Atom utf8_string = XInternAtom(display, "UTF8_STRING", false);
-
-        if (XGetWindowProperty(display, window->window, net_wm_name, 0, 1024,
-                               false, utf8_string, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &prop) == X11_Success &&
-            prop && strlen((char*)prop) != 0) {
-          window->name = std::string((char*)prop);
-          XFree(prop);
-        } else if (XGetWindowProperty(display, window->window, XA_WM_NAME, 0,
-                                      1024, false, XA_STRING, &actual_type,
-                                      &actual_format, &nitems, &bytes_after,
-                                      &prop) == X11_Success &&
-                   prop && strlen((char*)prop) != 0) {
-          window->name = std::string((char*)prop);
-          XFree(prop);
+        DoteWindowInfo* info = &windows.info(window);
+
+        // wherever it was last drawn needs repainting too, positions it
+        // passes through before the next frame never make it on screen
+        if (!info->update_pending)
+          damage_window(window);
+
+        // the event already says where the window is and whether its mapped,
+        // every window we know about started out with its CreateNotify
+        if (type == ConfigureNotify) {
+          window->x = event.xconfigure.x;
+          window->y = event.xconfigure.y;
+
+          window->width = event.xconfigure.width;
+          window->height = event.xconfigure.height;
+        } else if (type == MapNotify) {
+          // we only hear about children of the root, mapped means viewable
+          window->visible = 1;
+          window->map_generation++;
+        } else if (type == UnmapNotify) {
+          window->visible = 0;
         }
+        index_window(window);
 
-        Atom net_wm_window_type =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE", false);
-
-        const Atom window_type_desktop =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_DESKTOP", false);
-        Atom window_type_dock =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_DOCK", false);
-        Atom window_type_toolbar =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_TOOLBAR", false);
-        Atom window_type_menu =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_MENU", false);
-        Atom window_type_utility =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_UTILITY", false);
-        Atom window_type_splash =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_SPLASH", false);
-        Atom window_type_dialog =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_DIALOG", false);
-        Atom window_type_dropdown_menu =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", false);
-        Atom window_type_popup_menu =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_POPUP_MENU", false);
-        Atom window_type_tooltip =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_TOOLTIP", false);
-        Atom window_type_notification =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_NOTIFICATION", false);
-        Atom window_type_combo =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_COMBO", false);
-        Atom window_type_dnd =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_DND", false);
-        Atom window_type_normal =
-            XInternAtom(display, "_NET_WM_WINDOW_TYPE_NORMAL", false);
-
-        // default to normal if the window doesnt have it
-        window->type = WINDOW_TYPE_NORMAL;
-
-        if (XGetWindowProperty(display, window->window, net_wm_window_type, 0,
-                               1024, false, XA_ATOM, &actual_type,
-                               &actual_format, &nitems, &bytes_after,
-                               &prop) == X11_Success &&
-            prop) {
-          Atom atom = *(Atom*)prop;
-
-          if (atom == window_type_desktop) {
-            window->type = WINDOW_TYPE_DESKTOP;
-          } else if (atom == window_type_dock) {
-            window->type = WINDOW_TYPE_DOCK;
-          } else if (atom == window_type_toolbar) {
-            window->type = WINDOW_TYPE_TOOLBAR;
-          } else if (atom == window_type_menu) {
-            window->type = WINDOW_TYPE_MENU;
-          } else if (atom == window_type_utility) {
-            window->type = WINDOW_TYPE_UTILITY;
-          } else if (atom == window_type_splash) {
-            window->type = WINDOW_TYPE_SPLASH;
-          } else if (atom == window_type_dialog) {
-            window->type = WINDOW_TYPE_DIALOG;
-          } else if (atom == window_type_dropdown_menu) {
-            window->type = WINDOW_TYPE_DROPDOWN_MENU;
-          } else if (atom == window_type_popup_menu) {
-            window->type = WINDOW_TYPE_POPUP_MENU;
-          } else if (atom == window_type_tooltip) {
-            window->type = WINDOW_TYPE_TOOLTIP;
-          } else if (atom == window_type_notification) {
-            window->type = WINDOW_TYPE_NOTIFICATION;
-          } else if (atom == window_type_combo) {
-            window->type = WINDOW_TYPE_COMBO;
-          } else if (atom == window_type_dnd) {
-            window->type = WINDOW_TYPE_DND;
-          } else if (atom == window_type_normal) {
-            window->type = WINDOW_TYPE_NORMAL;
-          } else {
-            window->type = WINDOW_TYPE_NORMAL;
-          }
-
-          XFree(prop);
+        if (window->depth != 0.1) {
+          window->depth = 0.1;
+          windows.mark_unsorted();
         }
 
-        // serialize data to client if window not the base window
-        if (!base_window.has_value() || base_window.value() != window->window) {
-          Packet packet;
-          auto segment = packet.add_segments();
-          auto reply = segment->mutable_window_map_reply();
-          reply->set_window(window->window);
-          reply->set_visible(window->visible);
-          reply->set_x(window->x);
-          reply->set_y(window->y);
-          reply->set_width(window->width);
-          reply->set_height(window->height);
-          if (window->name.has_value()) {
-            reply->set_name(window->name.value());
-          }
-          reply->set_has_border(window->border.has_value());
-          reply->set_type(window->type);
-
-          size_t len = packet.ByteSizeLong();
-          char* buf = (char*)malloc(len);
-          packet.SerializeToArray(buf, len);
-
-          send_wrapper(ipc_sock, buf, len, 0);
-          free(buf);
+        // properties are read once, after that PropertyNotify says exactly
+        // which one changed so moving a window doesnt fetch anything
+        if (!info->metadata_cached) {
+          fetch_window_name(window);
+          fetch_window_type(window);
+          info->metadata_cached = true;
         }
 
-        if (!window->icon.has_value()) {
-          Atom net_wm_icon = XInternAtom(display, "_NET_WM_ICON", false);
-
-          if (XGetWindowProperty(display, window->window, net_wm_icon, 0,
-                                 128 * 128 * 10, false, XA_CARDINAL,
-                                 &actual_type, &actual_format, &nitems,
-                                 &bytes_after, &prop) == X11_Success &&
-              prop) {
-            unsigned long* data = (unsigned long*)prop;
-            if (nitems > 10 && nitems > data[0] * data[1]) {
-              printf("%ix%i icon\n", data[0], data[1]);
-              unsigned long width = data[0];
-              unsigned long height = data[1];
-
-              std::vector<unsigned char> image_data;
-              for (size_t i = 2; i < 2 + (width * height); i++) {
-                unsigned long pixel = data[i];
-                image_data.push_back((pixel >> 16) & 0xFF);
-                image_data.push_back((pixel >> 8) & 0xFF);
-                image_data.push_back(pixel & 0xFF);
-                image_data.push_back((pixel >> 24) & 0xFF);
-              }
-              std::vector<unsigned char> png_data;
-
-              lodepng::encode(png_data, image_data, width, height);
-
-              std::string image_base64 =
-                  "data:image/png;base64," +
-                  base64_encode(png_data.data(), png_data.size());
-
-              window->icon = image_base64;
-
-              Packet packet;
-              auto segment = packet.add_segments();
-              auto reply = segment->mutable_window_icon_reply();
-              reply->set_window(window->window);
-              reply->set_image(image_base64);
-
-              size_t len = packet.ByteSizeLong();
-              char* buf = (char*)malloc(len);
-              packet.SerializeToArray(buf, len);
-
-              send_wrapper(ipc_sock, buf, len, 0);
-            }
-
-            XFree(prop);
-          }
+        if (!info->icon_cached) {
+          queue_icon_update(window);
+          info->icon_cached = true;
         }
 
-        // we're updating the pixel coords
-        if (window->x_pixmap) {
-          XFreePixmap(display, window->x_pixmap);
-          window->x_pixmap = 0;
-        }
+        // the rest happens once per frame however many events came in
+        queue_window_update(window);
 
-        if (window->pixmap) {
-          glXDestroyPixmap(display, window->pixmap);
-          window->pixmap = 0;
-        }
+      } else if (type == PropertyNotify) {
+        DoteWindow* window = windows.find(event.xproperty.window);
 
-        GLfloat vertex_positions[4 * 2] = {
-            -1, -1, 1, -1, 1, 1, -1, 1,
-        };
-        GLubyte indices[6] = {// top tri
-                              0, 1, 2,
-                              // bottom tri
-                              0, 2, 3};
+        // nothing cached yet, the first map reads everything anyway
+        if (!window || !windows.info(window).metadata_cached)
+          goto done;
 
-        window->index_count = 6;
-        gl_set_vao_vbo_ibo_data(window->vao, window->vbo,
-                                sizeof(vertex_positions), vertex_positions,
-                                window->ibo, sizeof(indices), indices);
+        Atom atom = event.xproperty.atom;
 
-        if (base_window.has_value()) {
-          XLowerWindow(display, base_window.value());
+        if (atom == atoms.net_wm_name || atom == XA_WM_NAME) {
+          if (fetch_window_name(window))
+            queue_window_update(window);
+        } else if (atom == atoms.net_wm_window_type) {
+          if (fetch_window_type(window))
+            queue_window_update(window);
+        } else if (atom == atoms.net_wm_icon) {
+          queue_icon_update(window);
         }
-
       } else if (type == DestroyNotify) {
         Window x_window = event.xdestroywindow.window;
         if (!x_window)
           goto done;
 
-        if (windows[x_window].x_pixmap) {
-          XFreePixmap(display, windows[x_window].x_pixmap);
-          windows[x_window].x_pixmap = 0;
-        }
-
-        if (windows[x_window].pixmap) {
-          glXDestroyPixmap(display, windows[x_window].pixmap);
-          windows[x_window].pixmap = 0;
+        DoteWindow* window = windows.find(x_window);
+        if (window) {
+          release_window(window);
         }
 
         if (base_window.has_value() && x_window != base_window.value() &&
             x_window != 0) {
-          Packet packet;
-          auto segment = packet.add_segments();
+          auto segment = outgoing_segment();
           auto reply = segment->mutable_window_close_reply();
           reply->set_window(x_window);
-
-          size_t len = packet.ByteSizeLong();
-          char* buf = (char*)malloc(len);
-          packet.SerializeToArray(buf, len);
-
-          send_wrapper(ipc_sock, buf, len, 0);
         }
 
-        if (windows.find(x_window) == windows.end())
+        if (!window)
           goto done;
 
+        damage_window(window);
+        spatial_index.forget(x_window);
         windows.erase(x_window);
 
         update_client_list();
@@ -687,41 +1097,43 @@ bool DoteWindowManager::process_events() {
         printf("%i %i %i\n", event.xbutton.window, event.xbutton.button,
                event.xbutton.state);
 
+        // with raw events the browser hears about it from raw_button()
+        // instead, that sees clicks that never get grabbed too
+        if (click_mode == ClickMode::GRAB) {
+          send_pointer_press(event.xbutton.x_root, event.xbutton.y_root,
+                             event.xbutton.button, type == ButtonPress,
+                             event.xbutton.time);
+          if (type == ButtonPress)
+            click_latency.pressed();
+        }
+
         float depth = 2.0;
         bool is_border = false;
-        for (auto bordered_window : windows) {
-          if (!bordered_window.second.border.has_value())
+        // only the windows near the pointer can be under it
+        for (Window candidate : spatial_index.at(event.xbutton.x_root,
+                                                 event.xbutton.y_root)) {
+          DoteWindow* bordered_window = windows.find(candidate);
+          if (!bordered_window || !bordered_window->border.has_value())
             continue;
 
-          int border_x =
-              bordered_window.second.x + bordered_window.second.border->x;
-          int border_y =
-              bordered_window.second.y + bordered_window.second.border->y;
-          int border_x2 = bordered_window.second.x +
-                          bordered_window.second.width +
-                          bordered_window.second.border->width;
-          int border_y2 = bordered_window.second.y +
-                          bordered_window.second.height +
-                          bordered_window.second.border->height;
-
-          if (event.xbutton.x_root > border_x &&
-              event.xbutton.y_root > border_y &&
-              event.xbutton.x_root < border_x2 &&
-              event.xbutton.y_root < border_y2 &&
-              bordered_window.second.depth < depth) {
+          Rect border = border_rect(bordered_window).value();
+          Rect rect = window_rect(bordered_window);
+
+          if (event.xbutton.x_root > border.x &&
+              event.xbutton.y_root > border.y &&
+              event.xbutton.x_root < border.x + border.width &&
+              event.xbutton.y_root < border.y + border.height &&
+              bordered_window->depth < depth) {
             is_border = true;
-            depth = bordered_window.second.depth;
+            depth = bordered_window->depth;
           }
 
-          if (event.xbutton.x_root > bordered_window.second.x &&
-              event.xbutton.y_root > bordered_window.second.y &&
-              event.xbutton.x_root <
-                  bordered_window.second.x + bordered_window.second.width &&
-              event.xbutton.y_root <
-                  bordered_window.second.y + bordered_window.second.height &&
-              bordered_window.second.depth <= depth) {
+          if (event.xbutton.x_root > rect.x && event.xbutton.y_root > rect.y &&
+              event.xbutton.x_root < rect.x + rect.width &&
+              event.xbutton.y_root < rect.y + rect.height &&
+              bordered_window->depth <= depth) {
             is_border = false;
-            depth = bordered_window.second.depth;
+            depth = bordered_window->depth;
           }
         }
 
@@ -729,28 +1141,39 @@ bool DoteWindowManager::process_events() {
             event.xbutton.window != base_window.value()) {
           XAllowEvents(display, SyncPointer, CurrentTime);
 
-          printf("sending border\n");
-          XEvent forward_event;
-          forward_event.type = type;
-          forward_event.xbutton.type = type;
-          forward_event.xbutton.window = base_window.value();
-          forward_event.xbutton.display = display;
-          forward_event.xbutton.send_event = true;
-          forward_event.xbutton.root = root_window;
-          forward_event.xbutton.subwindow = base_window.value();
-          forward_event.xbutton.x_root = event.xbutton.x_root;
-          forward_event.xbutton.y_root = event.xbutton.y_root;
-          forward_event.xbutton.x = event.xbutton.x_root;
-          forward_event.xbutton.y = event.xbutton.y_root;
-          forward_event.xbutton.state = event.xbutton.state;
-          forward_event.xbutton.button = event.xbutton.button;
-          forward_event.xbutton.time = CurrentTime;
-          XSendEvent(display, base_window.value(), true,
-                     type == ButtonPress ? ButtonPressMask : ButtonReleaseMask,
-                     &forward_event);
+          // the browser already got the press over ipc
+          if (synthetic_pointer) {
+            printf("sending border\n");
+            XEvent forward_event;
+            forward_event.type = type;
+            forward_event.xbutton.type = type;
+            forward_event.xbutton.window = base_window.value();
+            forward_event.xbutton.display = display;
+            forward_event.xbutton.send_event = true;
+            forward_event.xbutton.root = root_window;
+            forward_event.xbutton.subwindow = base_window.value();
+            forward_event.xbutton.x_root = event.xbutton.x_root;
+            forward_event.xbutton.y_root = event.xbutton.y_root;
+            forward_event.xbutton.x = event.xbutton.x_root;
+            forward_event.xbutton.y = event.xbutton.y_root;
+            forward_event.xbutton.state = event.xbutton.state;
+            forward_event.xbutton.button = event.xbutton.button;
+            forward_event.xbutton.time = event.xbutton.time;
+            track_request("XSendEvent", base_window.value());
+            XSendEvent(
+                display, base_window.value(), true,
+                type == ButtonPress ? ButtonPressMask : ButtonReleaseMask,
+                &forward_event);
+          }
         } else {
           XAllowEvents(display, ReplayPointer, CurrentTime);
         }
+        // the pointer is frozen until the server sees that, dont leave it
+        // sitting in the buffer until the end of the loop
+        XFlush(display);
+        if (type == ButtonPress)
+          click_latency.frozen(event.xbutton.time,
+                               FrameScheduler::clock::now());
 
         if (type == ButtonPress && !is_border) {
           focus_window(x_window, true);
@@ -765,37 +1188,22 @@ bool DoteWindowManager::process_events() {
         // TODO
       }
     } else {
-      // xi events only
-      Window root_return, child_return;
-      int root_x_return, root_y_return;
-      int win_x_return, win_y_return;
-      unsigned int mask_return;
-      int retval = XQueryPointer(display, root_window, &root_return,
-                                 &child_return, &root_x_return, &root_y_return,
-                                 &win_x_return, &win_y_return, &mask_return);
-
-      if (!retval) {
-        goto done;
-      }
-
-      // got value, forward to base window
-
-      if (base_window.has_value()) {
-        XEvent forward_event;
-        forward_event.type = MotionNotify;
-        forward_event.xmotion.type = MotionNotify;
-        forward_event.xmotion.window = base_window.value();
-        forward_event.xmotion.display = display;
-        forward_event.xmotion.send_event = true;
-        forward_event.xmotion.root = root_window;
-        forward_event.xmotion.subwindow = base_window.value();
-        forward_event.xmotion.x_root = root_x_return;
-        forward_event.xmotion.y_root = root_y_return;
-        forward_event.xmotion.x = root_x_return;
-        forward_event.xmotion.y = root_y_return;
-        forward_event.xmotion.time = CurrentTime;
-        XSendEvent(display, base_window.value(), true, PointerMotionMask,
-                   &forward_event);
+      // xi events only, all of them raw
+      if (XGetEventData(display, &event.xcookie)) {
+        XIRawEvent* raw = (XIRawEvent*)event.xcookie.data;
+        click_latency.observe(raw->time, FrameScheduler::clock::now());
+
+        if (event.xcookie.evtype == XI_RawMotion) {
+          // raw motion doesnt say where the pointer went, so just remember
+          // that it moved and when, and ask once per frame
+          pointer_moved = true;
+          pointer_time = raw->time;
+          pointer_coalesced++;
+        } else if (event.xcookie.evtype == XI_RawButtonPress) {
+          raw_button(raw, true);
+        } else if (event.xcookie.evtype == XI_RawButtonRelease) {
+          raw_button(raw, false);
+        }
       }
     }
     XFreeEventData(display, &event.xcookie);
@@ -804,16 +1212,404 @@ done:
   return events_left;
 }
 
+FrameScheduler::clock::duration DoteWindowManager::pointer_period() {
+  return pointer_interval.value_or(scheduler.period());
+}
+
+void DoteWindowManager::forward_pointer() {
+  if (!pointer_moved)
+    return;
+
+  auto now = FrameScheduler::clock::now();
+  if (now - last_pointer_query < pointer_period())
+    return;
+
+  pointer_moved = false;
+  last_pointer_query = now;
+  uint32_t coalesced = pointer_coalesced;
+  pointer_coalesced = 0;
+
+  Window root_return, child_return;
+  int root_x_return, root_y_return;
+  int win_x_return, win_y_return;
+  unsigned int mask_return;
+  int retval = XQueryPointer(display, root_window, &root_return,
+                             &child_return, &root_x_return, &root_y_return,
+                             &win_x_return, &win_y_return, &mask_return);
+
+  if (!retval)
+    return;
+
+  // raw motion also fires for movement that gets clamped at the screen edge
+  if (root_x_return == pointer_x && root_y_return == pointer_y)
+    return;
+  pointer_x = root_x_return;
+  pointer_y = root_y_return;
+
+  if (!base_window.has_value())
+    return;
+
+  // rides along with the next outgoing packet, a newer position replaces it
+  // if that cant go out yet
+  pointer_unsent = true;
+  pointer_unsent_time = pointer_time;
+  pointer_unsent_coalesced += coalesced;
+
+  // got value, forward to base window
+
+  if (synthetic_pointer) {
+    XEvent forward_event;
+    forward_event.type = MotionNotify;
+    forward_event.xmotion.type = MotionNotify;
+    forward_event.xmotion.window = base_window.value();
+    forward_event.xmotion.display = display;
+    forward_event.xmotion.send_event = true;
+    forward_event.xmotion.root = root_window;
+    forward_event.xmotion.subwindow = base_window.value();
+    forward_event.xmotion.x_root = root_x_return;
+    forward_event.xmotion.y_root = root_y_return;
+    forward_event.xmotion.x = root_x_return;
+    forward_event.xmotion.y = root_y_return;
+    forward_event.xmotion.time = pointer_time;
+    track_request("XSendEvent", base_window.value());
+    XSendEvent(display, base_window.value(), true, PointerMotionMask,
+               &forward_event);
+  }
+}
+
+void DoteWindowManager::send_pointer_press(int x,
+                                           int y,
+                                           unsigned int button,
+                                           bool down,
+                                           Time time) {
+  if (!base_window.has_value())
+    return;
+
+  MouseButtonState state;
+  switch (button) {
+    case Button1:
+      state = down ? MOUSE_LEFT_DOWN : MOUSE_LEFT_UP;
+      break;
+    case Button2:
+      state = down ? MOUSE_MIDDLE_DOWN : MOUSE_MIDDLE_UP;
+      break;
+    case Button3:
+      state = down ? MOUSE_RIGHT_DOWN : MOUSE_RIGHT_UP;
+      break;
+    default:
+      // scroll wheel and side buttons, theres no state for those
+      return;
+  }
+
+  auto segment = outgoing_segment();
+  auto reply = segment->mutable_mouse_press_reply();
+  reply->set_x(x);
+  reply->set_y(y);
+  reply->set_state(state);
+  reply->set_time(time);
+}
+
+void DoteWindowManager::raw_button(XIRawEvent* raw, bool down) {
+  if (down)
+    click_latency.pressed();
+
+  // raw events dont carry a position. this is a round trip, but unlike a
+  // grab it doesnt hold the click back from whoever it's for
+  Window root_return, child_return;
+  int root_x_return, root_y_return;
+  int win_x_return, win_y_return;
+  unsigned int mask_return;
+  if (!XQueryPointer(display, root_window, &root_return, &child_return,
+                     &root_x_return, &root_y_return, &win_x_return,
+                     &win_y_return, &mask_return))
+    return;
+
+  send_pointer_press(root_x_return, root_y_return, raw->detail, down,
+                     raw->time);
+}
+
+void DoteWindowManager::grab_clicks(Window window) {
+  track_request("XGrabButton", window);
+  XGrabButton(display, AnyButton, AnyModifier, window, 1,
+              ButtonPressMask | ButtonReleaseMask | ButtonMotionMask,
+              GrabModeSync, GrabModeSync, 0, 0);
+}
+
+void DoteWindowManager::ungrab_clicks(Window window) {
+  track_request("XUngrabButton", window);
+  XUngrabButton(display, AnyButton, AnyModifier, window);
+}
+
+bool DoteWindowManager::fetch_window_name(DoteWindow* window) {
+  // only when the name changes, which is rare enough
+  AllocationExemption exemption;
+  std::optional<std::string> name;
+
+  Atom actual_type;
+  int actual_format;
+  unsigned long nitems, bytes_after;
+  unsigned char* prop = nullptr;
+
+  track_request("XGetWindowProperty", window->window);
+  if (XGetWindowProperty(display, window->window, atoms.net_wm_name, 0, 1024,
+                         false, atoms.utf8_string, &actual_type,
+                         &actual_format, &nitems, &bytes_after,
+                         &prop) == X11_Success &&
+      prop && strlen((char*)prop) != 0) {
+    name = std::string((char*)prop);
+  }
+  if (prop) {
+    XFree(prop);
+    prop = nullptr;
+  }
+
+  if (!name.has_value() &&
+      XGetWindowProperty(display, window->window, XA_WM_NAME, 0, 1024, false,
+                         XA_STRING, &actual_type, &actual_format, &nitems,
+                         &bytes_after, &prop) == X11_Success &&
+      prop && strlen((char*)prop) != 0) {
+    name = std::string((char*)prop);
+  }
+  if (prop)
+    XFree(prop);
+
+  DoteWindowInfo* info = &windows.info(window);
+  if (name == info->name)
+    return false;
+  info->name = name;
+  return true;
+}
+
+bool DoteWindowManager::fetch_window_type(DoteWindow* window) {
+  // default to normal if the window doesnt have it
+  WindowType type = WINDOW_TYPE_NORMAL;
+
+  Atom actual_type;
+  int actual_format;
+  unsigned long nitems, bytes_after;
+  unsigned char* prop = nullptr;
+
+  track_request("XGetWindowProperty", window->window);
+  if (XGetWindowProperty(display, window->window, atoms.net_wm_window_type, 0,
+                         1024, false, XA_ATOM, &actual_type, &actual_format,
+                         &nitems, &bytes_after, &prop) == X11_Success &&
+      prop) {
+    if (nitems > 0)
+      type = atoms.window_type(*(Atom*)prop);
+    XFree(prop);
+  }
+
+  DoteWindowInfo* info = &windows.info(window);
+  if (type == info->type)
+    return false;
+  info->type = type;
+  return true;
+}
+
+void DoteWindowManager::fetch_window_icon(DoteWindow* window) {
+  Atom actual_type;
+  int actual_format;
+  unsigned long nitems, bytes_after;
+  unsigned char* prop = nullptr;
+
+  track_request("XGetWindowProperty", window->window);
+  if (XGetWindowProperty(display, window->window, atoms.net_wm_icon, 0,
+                         128 * 128 * 10, false, XA_CARDINAL, &actual_type,
+                         &actual_format, &nitems, &bytes_after,
+                         &prop) != X11_Success ||
+      !prop)
+    return;
+
+  unsigned long* data = (unsigned long*)prop;
+  if (nitems > 10 && nitems > data[0] * data[1]) {
+    printf("%ix%i icon\n", data[0], data[1]);
+    unsigned long width = data[0];
+    unsigned long height = data[1];
+
+    std::vector<unsigned char> image_data;
+    for (size_t i = 2; i < 2 + (width * height); i++) {
+      unsigned long pixel = data[i];
+      image_data.push_back((pixel >> 16) & 0xFF);
+      image_data.push_back((pixel >> 8) & 0xFF);
+      image_data.push_back(pixel & 0xFF);
+      image_data.push_back((pixel >> 24) & 0xFF);
+    }
+    std::vector<unsigned char> png_data;
+
+    lodepng::encode(png_data, image_data, width, height);
+
+    std::string image_base64 =
+        "data:image/png;base64," +
+        base64_encode(png_data.data(), png_data.size());
+
+    DoteWindowInfo* info = &windows.info(window);
+    if (image_base64 != info->icon) {
+      info->icon = image_base64;
+
+      auto segment = outgoing_segment();
+      auto reply = segment->mutable_window_icon_reply();
+      reply->set_window(window->window);
+      reply->set_image(image_base64);
+    }
+  }
+
+  XFree(prop);
+}
+
+void DoteWindowManager::queue_window_update(DoteWindow* window) {
+  DoteWindowInfo* info = &windows.info(window);
+  if (info->update_pending)
+    return;
+  info->update_pending = true;
+  pending_updates.push_back(window->window);
+}
+
+void DoteWindowManager::flush_window_updates() {
+  if (pending_updates.empty())
+    return;
+
+  for (Window x_window : pending_updates) {
+    DoteWindow* window = windows.find(x_window);
+    // destroyed while it was waiting
+    if (!window)
+      continue;
+
+    windows.info(window).update_pending = false;
+
+    damage_window(window);
+    send_window_map_reply(window);
+
+    if (window_pixmap_stale(window))
+      destroy_window_pixmap(window);
+  }
+  pending_updates.clear();
+
+  if (base_window.has_value()) {
+    XLowerWindow(display, base_window.value());
+  }
+}
+
+void DoteWindowManager::queue_icon_update(DoteWindow* window) {
+  DoteWindowInfo* info = &windows.info(window);
+  if (info->icon_pending)
+    return;
+  info->icon_pending = true;
+  AllocationExemption exemption;
+  pending_icons.push(window->window);
+}
+
+void DoteWindowManager::background_step() {
+  // icons get png encoded, which is slow enough to drop frames when a bunch
+  // of windows show up at once. it allocates plenty but only runs when an
+  // icon changed
+  AllocationExemption exemption;
+  background_budget.start(scheduler.render_by(FrameScheduler::clock::now()));
+  while (!pending_icons.empty() && background_budget.allow()) {
+    Window x_window = pending_icons.front();
+    pending_icons.pop();
+
+    DoteWindow* window = windows.find(x_window);
+    if (!window)
+      continue;
+
+    windows.info(window).icon_pending = false;
+    fetch_window_icon(window);
+  }
+  background_budget.stop();
+}
+
+void DoteWindowManager::send_window_map_reply(DoteWindow* window) {
+  // the browser draws the base window, it doesnt need to hear about it
+  if (base_window.has_value() && base_window.value() == window->window)
+    return;
+
+  auto segment = outgoing_segment();
+  auto reply = segment->mutable_window_map_reply();
+  reply->set_window(window->window);
+  reply->set_visible(window->visible);
+  reply->set_x(window->x);
+  reply->set_y(window->y);
+  reply->set_width(window->width);
+  reply->set_height(window->height);
+  const DoteWindowInfo& info = windows.info(window);
+  if (info.name.has_value()) {
+    reply->set_name(info.name.value());
+  }
+  reply->set_has_border(window->border.has_value());
+  reply->set_type(info.type);
+}
+
+DataSegment* DoteWindowManager::outgoing_segment() {
+  if (!outgoing) {
+    outgoing = new_packet();
+  } else if (outgoing_held) {
+    // the browser is out of credit and this keeps piling up past the
+    // arena's block
+    AllocationExemption exemption;
+    return outgoing->add_segments();
+  }
+  return outgoing->add_segments();
+}
+
+void DoteWindowManager::flush_outgoing() {
+  // the pointer only gets a segment if theres credit to send it with, so it
+  // never takes up room in a packet that has to wait
+  if (pointer_unsent && can_send != 0) {
+    auto reply = outgoing_segment()->mutable_mouse_move_reply();
+    reply->set_x(pointer_x);
+    reply->set_y(pointer_y);
+    reply->set_time(pointer_unsent_time);
+    reply->set_coalesced(pointer_unsent_coalesced);
+    pointer_unsent = false;
+    pointer_unsent_coalesced = 0;
+  }
+
+  if (!outgoing)
+    return;
+
+  // out of credit, keep it and whatever gets added until the browser says
+  // it caught up instead of losing window updates
+  if (can_send == 0) {
+    outgoing_held = true;
+    return;
+  }
+
+  send_packet(*outgoing);
+  outgoing = nullptr;
+  outgoing_held = false;
+}
+
+void DoteWindowManager::send_packet(const Packet& packet, bool spend_credit) {
+  size_t len = packet.ByteSizeLong();
+  void* buf;
+  if (frame_arena.fits(len)) {
+    buf = frame_arena.allocate(len);
+  } else {
+    // icons and other big replies go to the heap, they only get sent when
+    // something changed
+    AllocationExemption exemption;
+    buf = frame_arena.allocate(len);
+  }
+  packet.SerializeToArray(buf, len);
+
+  // nn_send copies it, the arena gets reset before the next frame
+  if (spend_credit)
+    send_wrapper(ipc_sock, buf, len, 0);
+  else
+    nn_send(ipc_sock, buf, len, 0);
+}
+
 void DoteWindowManager::update_client_list() {
   Window* client_list = (Window*)malloc(windows.size() * sizeof(Window));
 
   size_t i = 0;
-  for (auto window : windows) {
-    client_list[i] = window.second.window;
+  for (auto& window : windows) {
+    client_list[i] = window.window;
     i++;
   }
 
-  XChangeProperty(display, root_window, client_list_atom, XA_WINDOW, 32,
+  track_request("XChangeProperty", root_window);
+  XChangeProperty(display, root_window, atoms.net_client_list, XA_WINDOW, 32,
                   PropModeReplace, (unsigned char*)client_list, windows.size());
   free(client_list);
 }
@@ -822,35 +1618,98 @@ void DoteWindowManager::focus_window(Window window_id, bool send_event) {
   if (base_window.has_value() && window_id == base_window.value())
     return;
 
+  // clicking the focused window wouldnt change anything, let its clicks
+  // through untouched. whatever had focus before needs the grab back so
+  // clicking it focuses it again
+  if (click_mode == ClickMode::RAW && focused_window != window_id) {
+    if (focused_window.has_value() && windows.find(focused_window.value()))
+      grab_clicks(focused_window.value());
+    ungrab_clicks(window_id);
+  }
+
+  track_request("XSetInputFocus", window_id);
   XSetInputFocus(display, window_id, RevertToParent, CurrentTime);
+  track_request("XMapRaised", window_id);
   XMapRaised(display, window_id);
 
   printf("sending focus!\n");
 
   if (send_event) {
-    Packet packet;
-    auto segment = packet.add_segments();
+    auto segment = outgoing_segment();
     auto reply = segment->mutable_window_focus_reply();
     reply->set_window(window_id);
+  }
 
-    size_t len = packet.ByteSizeLong();
-    char* buf = (char*)malloc(len);
-    packet.SerializeToArray(buf, len);
+  focused_window = window_id;
+}
 
-    send_wrapper(ipc_sock, buf, len, 0);
-    free(buf);
+static GrabMode grab_mode_from_env() {
+  const char* env = std::getenv("DOTE_GRAB_MODE");
+  if (env == NULL)
+    return GrabMode::FRAME;
+
+  if (strcmp(env, "window") == 0)
+    return GrabMode::WINDOW;
+  if (strcmp(env, "none") == 0)
+    return GrabMode::NONE;
+  if (strcmp(env, "frame") != 0)
+    printf("unknown DOTE_GRAB_MODE %s, using frame\n", env);
+
+  return GrabMode::FRAME;
+}
+
+static const char* grab_mode_name(GrabMode mode) {
+  switch (mode) {
+    case GrabMode::WINDOW:
+      return "window";
+    case GrabMode::FRAME:
+      return "frame";
+    case GrabMode::NONE:
+      return "none";
   }
+  return "unknown";
+}
 
-  focused_window = window_id;
+static ClickMode click_mode_from_env() {
+  const char* env = std::getenv("DOTE_CLICK_MODE");
+  if (env == NULL)
+    return ClickMode::RAW;
+
+  if (strcmp(env, "grab") == 0)
+    return ClickMode::GRAB;
+  if (strcmp(env, "raw") != 0)
+    printf("unknown DOTE_CLICK_MODE %s, using raw\n", env);
+
+  return ClickMode::RAW;
+}
+
+static const char* click_mode_name(ClickMode mode) {
+  switch (mode) {
+    case ClickMode::GRAB:
+      return "grab";
+    case ClickMode::RAW:
+      return "raw";
+  }
+  return "unknown";
 }
 
 std::optional<DoteWindowManager*> DoteWindowManager::create() {
+  // the probe talks to the server from its own thread
+  bool grab_bench = std::getenv("DOTE_GRAB_BENCH") != NULL;
+  if (grab_bench)
+    XInitThreads();
+
   DoteWindowManager* ret = new DoteWindowManager;
   ret->display = XOpenDisplay(NULL);
   if (ret->display == NULL)
     return {};
 
-  XSynchronize(ret->display, 1);
+  if (!ret->event_loop.valid())
+    return {};
+  ret->event_loop.watch(ConnectionNumber(ret->display), EVENT_SOURCE_X);
+
+  ret->grab_mode = grab_mode_from_env();
+  printf("grab mode %s\n", grab_mode_name(ret->grab_mode));
 
   ret->screen = DefaultScreen(ret->display);
   ret->root_window = DefaultRootWindow(ret->display);
@@ -860,58 +1719,67 @@ std::optional<DoteWindowManager*> DoteWindowManager::create() {
 
   ret->screen_width = root_attributes.width;
   ret->screen_height = root_attributes.height;
+  ret->spatial_index.resize(ret->screen_width, ret->screen_height);
+  // rect_covered never grows these, past this many pieces it gives up
+  ret->occlusion_scratch.reserve(64);
+  ret->occlusion_scratch2.reserve(64);
 
   XSelectInput(ret->display, ret->root_window,
                SubstructureNotifyMask | PointerMotionMask | ButtonMotionMask |
                    ButtonPressMask | ButtonReleaseMask);
 
-  ret->client_list_atom = XInternAtom(ret->display, "_NET_CLIENT_LIST", 0);
+  if (!ret->atoms.intern(ret->display, ret->screen))
+    return {};
 
-  Atom supported_list_atom = XInternAtom(ret->display, "_NET_SUPPORTED", 0);
-  Atom supported_atoms[] = {supported_list_atom, ret->client_list_atom};
+  Atom supported_atoms[] = {ret->atoms.net_supported,
+                            ret->atoms.net_client_list};
 
-  XChangeProperty(ret->display, ret->root_window, supported_list_atom, XA_ATOM,
-                  32, PropModeReplace, (const unsigned char*)supported_atoms,
+  XChangeProperty(ret->display, ret->root_window, ret->atoms.net_supported,
+                  XA_ATOM, 32, PropModeReplace,
+                  (const unsigned char*)supported_atoms,
                   sizeof(supported_atoms) / sizeof(*supported_atoms));
 
   // this bit is alegedy some gnome jank
-  Atom supporting_wm_check_atom =
-      XInternAtom(ret->display, "_NET_SUPPORTING_WM_CHECK", 0);
   Window support_window =
       XCreateSimpleWindow(ret->display, ret->root_window, 0, 0, 1, 1, 0, 0, 0);
 
   Window support_window_list[1] = {support_window};
 
-  XChangeProperty(ret->display, ret->root_window, supporting_wm_check_atom,
-                  XA_WINDOW, 32, PropModeReplace,
-                  (const unsigned char*)support_window_list, 1);
-  XChangeProperty(ret->display, support_window, supporting_wm_check_atom,
-                  XA_WINDOW, 32, PropModeReplace,
-                  (const unsigned char*)support_window_list, 1);
-
-  Atom name_atom = XInternAtom(ret->display, "_NET_WM_NAME", 0);
-  XChangeProperty(ret->display, support_window, name_atom, XA_STRING, 8,
-                  PropModeReplace, (const unsigned char*)NAME, sizeof(NAME));
+  XChangeProperty(ret->display, ret->root_window,
+                  ret->atoms.net_supporting_wm_check, XA_WINDOW, 32,
+                  PropModeReplace, (const unsigned char*)support_window_list,
+                  1);
+  XChangeProperty(ret->display, support_window,
+                  ret->atoms.net_supporting_wm_check, XA_WINDOW, 32,
+                  PropModeReplace, (const unsigned char*)support_window_list,
+                  1);
+
+  XChangeProperty(ret->display, support_window, ret->atoms.net_wm_name,
+                  XA_STRING, 8, PropModeReplace, (const unsigned char*)NAME,
+                  sizeof(NAME));
   // sick
 
   XSetErrorHandler(x11_error_handler);
 
-  ret->blacklisted_windows.push_back(support_window);
+  ret->windows.blacklist(support_window);
 
   Window screen_owner =
       XCreateSimpleWindow(ret->display, ret->root_window, 0, 0, 1, 1, 0, 0, 0);
   Xutf8SetWMProperties(ret->display, screen_owner, "xcompmgr", "xcompmgr", NULL,
                        0, NULL, NULL, NULL);
 
-  char name[] = "_NET_WM_CM_S##";
-  snprintf(name, sizeof(name), "_NET_WM_CM_S%d", ret->screen);
-
-  Atom atom = XInternAtom(ret->display, name, 0);
-  XSetSelectionOwner(ret->display, atom, screen_owner, 0);
+  XSetSelectionOwner(ret->display, ret->atoms.net_wm_cm_s, screen_owner, 0);
 
   XCompositeRedirectSubwindows(ret->display, ret->root_window,
                                CompositeRedirectManual);
 
+  int damage_error_base;
+  if (!XDamageQueryExtension(ret->display, &ret->damage_event_base,
+                             &damage_error_base)) {
+    printf("xdamage not available\n");
+    return {};
+  }
+
   ret->overlay_window =
       XCompositeGetOverlayWindow(ret->display, ret->root_window);
 
@@ -978,6 +1846,8 @@ std::optional<DoteWindowManager*> DoteWindowManager::create() {
   if (!ret->glx_configs)
     return {};
 
+  ret->build_pixmap_formats();
+
   // create our OpenGL context
   // we must load the 'glXCreateContextAttribsARB' function ourselves
 
@@ -1008,6 +1878,86 @@ std::optional<DoteWindowManager*> DoteWindowManager::create() {
   // finally, make the context we just made the OpenGL context of this thread
   glXMakeCurrent(ret->display, ret->output_window, ret->glx_context);
 
+  // partial repaints need to know what is still in the back buffer
+  const char* glx_extensions =
+      glXQueryExtensionsString(ret->display, ret->screen);
+  ret->glXCopySubBufferMESA = (glXCopySubBufferMESA_t)glXGetProcAddress(
+      (const GLubyte*)"glXCopySubBufferMESA");
+
+  if (strstr(glx_extensions, "GLX_EXT_buffer_age")) {
+    ret->present_mode = PresentMode::BUFFER_AGE;
+    printf("present mode buffer age\n");
+  } else if (strstr(glx_extensions, "GLX_MESA_copy_sub_buffer") &&
+             ret->glXCopySubBufferMESA) {
+    ret->present_mode = PresentMode::COPY_SUB_BUFFER;
+    printf("present mode copy sub buffer\n");
+  } else {
+    ret->present_mode = PresentMode::FULL;
+    printf("present mode full\n");
+  }
+
+  // vsync, gives the scheduler a vblank to line frames up with. copying sub
+  // buffers isnt synced to anything so theres no point there
+  glXSwapIntervalEXT_t glXSwapIntervalEXT =
+      (glXSwapIntervalEXT_t)glXGetProcAddress(
+          (const GLubyte*)"glXSwapIntervalEXT");
+  if (ret->present_mode != PresentMode::COPY_SUB_BUFFER &&
+      strstr(glx_extensions, "GLX_EXT_swap_control") && glXSwapIntervalEXT) {
+    glXSwapIntervalEXT(ret->display, ret->output_window, 1);
+    ret->vsync = true;
+  }
+  ret->scheduler.set_vsync(ret->vsync);
+
+  PFNGLXGETMSCRATEOMLPROC glXGetMscRateOML =
+      (PFNGLXGETMSCRATEOMLPROC)glXGetProcAddress(
+          (const GLubyte*)"glXGetMscRateOML");
+  int32_t rate_numerator, rate_denominator;
+  if (strstr(glx_extensions, "GLX_OML_sync_control") && glXGetMscRateOML &&
+      glXGetMscRateOML(ret->display, ret->output_window, &rate_numerator,
+                       &rate_denominator) &&
+      rate_numerator > 0) {
+    ret->scheduler.set_refresh_period(std::chrono::nanoseconds(
+        (int64_t)1000000000 * rate_denominator / rate_numerator));
+  }
+
+  // where vblank is, without blocking on the swap. the driver can tell us
+  // the last one directly, failing that the server sends an event for each
+  // completed swap. with neither the frames just go out when theyre ready
+  // and the driver holds the swap back to the refresh rate
+  ret->glXGetSyncValuesOML = (PFNGLXGETSYNCVALUESOMLPROC)glXGetProcAddress(
+      (const GLubyte*)"glXGetSyncValuesOML");
+  int64_t ust, msc, sbc;
+  int glx_error_base;
+  if (!ret->vsync) {
+    ret->vblank_source = VblankSource::NOMINAL;
+  } else if (strstr(glx_extensions, "GLX_OML_sync_control") &&
+             ret->glXGetSyncValuesOML &&
+             ret->glXGetSyncValuesOML(ret->display, ret->output_window, &ust,
+                                      &msc, &sbc)) {
+    ret->vblank_source = VblankSource::OML;
+    ret->swaps_queued = sbc;
+  } else if (strstr(glx_extensions, "GLX_INTEL_swap_event") &&
+             glXQueryExtension(ret->display, &glx_error_base,
+                               &ret->glx_event_base)) {
+    glXSelectEvent(ret->display, ret->output_window,
+                   GLX_BUFFER_SWAP_COMPLETE_INTEL_MASK);
+    ret->vblank_source = VblankSource::SWAP_EVENT;
+  }
+
+  if (const char* env = std::getenv("DOTE_RENDER_DEADLINE_US")) {
+    ret->scheduler.set_render_deadline(
+        std::chrono::microseconds(std::atoi(env)));
+  }
+  if (const char* env = std::getenv("DOTE_POINTER_INTERVAL_US")) {
+    ret->pointer_interval = std::chrono::microseconds(std::atoi(env));
+  }
+  if (const char* env = std::getenv("DOTE_SYNTHETIC_POINTER")) {
+    ret->synthetic_pointer = strcmp(env, "0") != 0;
+  }
+  const char* vblank_source_names[] = {"oml", "swap events", "none"};
+  printf("vsync %s, vblank from %s\n", ret->vsync ? "on" : "off",
+         vblank_source_names[(int)ret->vblank_source]);
+
   // initialize GLEW
   // this will be needed for most modern OpenGL calls
 
@@ -1015,62 +1965,100 @@ std::optional<DoteWindowManager*> DoteWindowManager::create() {
   if (glewInit() != GLEW_OK)
     return {};
 
+  // every window is one instance of the same quad, the per window rects
+  // come from the instance buffer
   const char* vertex_shader_source =
       "#version 330\n"
       "layout(location = 0) in vec2 vertex_position;"
-      "out vec2 local_position;"
+      "layout(location = 1) in vec4 source;"   // position, size
+      "layout(location = 2) in vec4 cropped;"  // cropped position, size
+      "layout(location = 3) in vec2 depth_opacity;"
+      "layout(location = 4) in int slot;"
 
-      "uniform float depth;"
-      "uniform vec2 position;"
-      "uniform vec2 size;"
-      "uniform vec2 cropped_position;"
-      "uniform vec2 cropped_size;"
+      "out vec2 texture_position;"
+      "flat out float opacity;"
+      "flat out int texture_slot;"
 
       "void main(void) {"
-      "   local_position = vertex_position;"
-      "   gl_Position = vec4(vertex_position * (cropped_size/2) + "
-      "cropped_position, depth, "
-      "1.0);"
+      "   vec2 screen_position = vertex_position * (cropped.zw/2) + "
+      "cropped.xy;"
+      "   vec2 uncroped_position = (screen_position - source.xy) / "
+      "(source.zw/2);"
+      "   texture_position = uncroped_position * vec2(0.5, -0.5) + "
+      "vec2(0.5);"
+      "   opacity = depth_opacity.y;"
+      "   texture_slot = slot;"
+      "   gl_Position = vec4(screen_position, depth_opacity.x, 1.0);"
       "}";
 
-  const char* fragment_shader_source =
+  // glsl 330 only lets us index sampler arrays with constants, so spell out
+  // a case for every unit
+  std::string fragment_shader_source =
       "#version 330\n"
-      "in vec2 local_position;"
+      "in vec2 texture_position;"
+      "flat in float opacity;"
+      "flat in int texture_slot;"
       "out vec4 fragment_colour;"
 
-      "uniform float opacity;"
-      "uniform sampler2D texture_sampler;"
-      "uniform vec2 position;"
-      "uniform vec2 size;"
-      "uniform vec2 cropped_position;"
-      "uniform vec2 cropped_size;"
+      "uniform sampler2D textures[" +
+      std::to_string(BATCH_TEXTURE_UNITS) +
+      "];"
 
       "void main(void) {"
-      "   vec2 uncroped_position = (local_position / "
-      "((size/2)/(cropped_size/2)) - position + cropped_position);"
-      "   vec4 colour = texture(texture_sampler, uncroped_position  * "
-      "vec2(0.5, -0.5) + vec2(0.5));"
+      "   vec4 colour = vec4(0);"
+      "   switch (texture_slot) {";
+  for (int i = 0; i < BATCH_TEXTURE_UNITS; i++) {
+    fragment_shader_source += "case " + std::to_string(i) +
+                              ": colour = texture(textures[" +
+                              std::to_string(i) +
+                              "], texture_position); break;";
+  }
+  fragment_shader_source +=
+      "   }"
       "   float alpha = opacity * colour.a;"
       "   fragment_colour = vec4(colour.rgb, alpha);"
       "}";
 
-  ret->shader =
-      gl_create_shader_program(vertex_shader_source, fragment_shader_source);
-  ret->texture_uniform = glGetUniformLocation(ret->shader, "texture_sampler");
-
-  ret->opacity_uniform = glGetUniformLocation(ret->shader, "opacity");
-  ret->depth_uniform = glGetUniformLocation(ret->shader, "depth");
+  ret->shader = gl_create_shader_program(vertex_shader_source,
+                                         fragment_shader_source.c_str());
 
-  ret->position_uniform = glGetUniformLocation(ret->shader, "position");
-  ret->size_uniform = glGetUniformLocation(ret->shader, "size");
+  GLint texture_units[BATCH_TEXTURE_UNITS];
+  for (int i = 0; i < BATCH_TEXTURE_UNITS; i++) {
+    texture_units[i] = i;
+  }
+  glUseProgram(ret->shader);
+  glUniform1iv(glGetUniformLocation(ret->shader, "textures"),
+               BATCH_TEXTURE_UNITS, texture_units);
 
-  ret->cropped_position_uniform =
-      glGetUniformLocation(ret->shader, "cropped_position");
-  ret->cropped_size_uniform = glGetUniformLocation(ret->shader, "cropped_size");
+  // the one quad every window gets drawn with
+  GLfloat vertex_positions[4 * 2] = {
+      -1, -1, 1, -1, 1, 1, -1, 1,
+  };
+  GLubyte indices[6] = {// top tri
+                        0, 1, 2,
+                        // bottom tri
+                        0, 2, 3};
+
+  gl_create_vao_vbo_ibo(&ret->quad_vao, &ret->quad_vbo, &ret->quad_ibo);
+  gl_set_vao_vbo_ibo_data(ret->quad_vao, ret->quad_vbo,
+                          sizeof(vertex_positions), vertex_positions,
+                          ret->quad_ibo, sizeof(indices), indices);
+
+  glGenBuffers(1, &ret->instance_vbo);
+
+  // the quad vao, vbo and ibo plus the instance buffer, shared by every
+  // window for the life of the wm
+  for (int i = 0; i < 4; i++)
+    ret->resources.created(GLResources::BUFFER);
+  ret->set_instance_attributes(0);
+  for (GLuint attribute = 1; attribute <= 4; attribute++) {
+    glEnableVertexAttribArray(attribute);
+    glVertexAttribDivisor(attribute, 1);
+  }
 
   // blacklist the overlay and output windows for events
-  ret->blacklisted_windows.push_back(ret->overlay_window);
-  ret->blacklisted_windows.push_back(ret->output_window);
+  ret->windows.blacklist(ret->overlay_window);
+  ret->windows.blacklist(ret->output_window);
 
   // https://stackoverflow.com/questions/62448181/how-do-i-monitor-mouse-movement-events-in-all-windows-not-just-one-on-x11#62469861
   int event, error;
@@ -1079,16 +2067,28 @@ std::optional<DoteWindowManager*> DoteWindowManager::create() {
     return {};
   }
 
+  // raw events only reach the root during grabs from 2.1 on
   int major = 2;
-  int minor = 0;
+  int minor = 1;
   int retval = XIQueryVersion(ret->display, &major, &minor);
   if (retval != X11_Success) {
     return {};
   }
 
+  ret->click_mode = click_mode_from_env();
+  if (ret->click_mode == ClickMode::RAW && major == 2 && minor < 1) {
+    printf("xinput %i.%i has no raw events during grabs\n", major, minor);
+    ret->click_mode = ClickMode::GRAB;
+  }
+  printf("click mode %s\n", click_mode_name(ret->click_mode));
+
   unsigned char mask_bytes[(XI_LASTEVENT + 7) / 8] = {0};
   // select direct motion events
   XISetMask(mask_bytes, XI_RawMotion);
+  if (ret->click_mode == ClickMode::RAW) {
+    XISetMask(mask_bytes, XI_RawButtonPress);
+    XISetMask(mask_bytes, XI_RawButtonRelease);
+  }
 
   XIEventMask evmasks[1];
   evmasks[0].deviceid = XIAllMasterDevices;
@@ -1096,15 +2096,14 @@ std::optional<DoteWindowManager*> DoteWindowManager::create() {
   evmasks[0].mask = mask_bytes;
   XISelectEvents(ret->display, ret->root_window, evmasks, 1);
 
-  return ret;
-}
-void DoteWindowManager::unbind_window_texture(Window window_index) {
-  DoteWindow* window = &windows[window_index];
+  if (grab_bench) {
+    ret->latency_probe.emplace(std::string("grab mode ") +
+                               grab_mode_name(ret->grab_mode));
+    ret->latency_probe->start();
+  }
 
-  glXReleaseTexImageEXT(display, window->pixmap, GLX_FRONT_LEFT_EXT);
-  XUngrabServer(display);
+  return ret;
 }
-
 float DoteWindowManager::height_dimension_to_float(int pixels) {
   return (float)pixels / screen_height * 2;
 }
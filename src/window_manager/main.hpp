@@ -7,20 +7,25 @@
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XInput2.h>
 #include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xfixes.h>
 #include <X11/extensions/shape.h>
+#include <google/protobuf/arena.h>
 #include <nanomsg/nn.h>
 #include <nanomsg/pair.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/inotify.h>
 #include <unistd.h>
-#include <condition_variable>
+#include <atomic>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <mutex>
 #include <queue>
+#include <thread>
 #include <unordered_map>
 
 #undef Status
@@ -32,6 +37,20 @@
 #undef Success
 
 #include "../protobuf/starting_send.h"
+#include "allocation_counter.hpp"
+#include "atoms.hpp"
+#include "click_latency.hpp"
+#include "event_loop.hpp"
+#include "frame_arena.hpp"
+#include "frame_scheduler.hpp"
+#include "gl_resources.hpp"
+#include "latency_probe.hpp"
+#include "packet_ring.hpp"
+#include "region.hpp"
+#include "spatial_grid.hpp"
+#include "window_registry.hpp"
+#include "work_budget.hpp"
+#include "x_request_log.hpp"
 #include "windowmanager.pb.h"
 
 #include <sys/time.h>
@@ -50,20 +69,47 @@ typedef void (*glXReleaseTexImageEXT_t)(Display*, GLXDrawable, int);
 
 typedef void (*glXSwapIntervalEXT_t)(Display*, GLXDrawable, int);
 
+typedef void (*glXCopySubBufferMESA_t)(Display*, GLXDrawable, int, int, int,
+                                       int);
+
+// how finished frames get onto the screen
+enum class PresentMode {
+  FULL,             // repaint and swap the whole screen every frame
+  BUFFER_AGE,       // repaint whatever changed since the back buffer was drawn
+  COPY_SUB_BUFFER,  // never swap, copy the repainted area to the front
+};
+
+// where the scheduler learns when vblank happened
+enum class VblankSource {
+  OML,         // ask the driver for the time of the last vblank
+  SWAP_EVENT,  // the server tells us when each swap completed
+  NOMINAL,     // nothing to go on, frames go out as soon as theyre ready
+};
+
+// how texture refreshes are kept consistent with what clients are drawing
+enum class GrabMode {
+  WINDOW,  // grab the server around every window refresh (old behaviour)
+  FRAME,   // at most one grab per frame around all of the refreshes
+  NONE,    // never grab, just glXWaitX once before refreshing
+};
+
+// how clicks reach the wm so it can focus the window that was clicked
+enum class ClickMode {
+  GRAB,  // synchronous grab on every window, each press freezes the pointer
+         // until we get round to it (old behaviour)
+  RAW,   // xi2 raw button events, only unfocused windows keep the grab
+};
+
 struct DoteWindowBorder {
   int x, y;
   int width, height;
 };
 
+// what the renderer looks at every frame
 struct DoteWindow {
   int exists;
   Window window;
 
-  std::optional<std::string> name;
-  WindowType type;
-
-  std::optional<std::string> icon;  // base64 png
-
   int visible;
 
   float opacity;
@@ -73,11 +119,83 @@ struct DoteWindow {
 
   std::optional<DoteWindowBorder> border;
 
+  Damage damage;
+  bool damaged;
+
   Pixmap x_pixmap;
   GLXPixmap pixmap;
 
-  int index_count;
-  GLuint vao, vbo, ibo;
+  // bits per pixel of the window's visual, 0 until we asked
+  int bit_depth;
+
+  // what the pixmap was named for, bumped on every map
+  int pixmap_width, pixmap_height;
+  uint32_t map_generation;
+  uint32_t pixmap_generation;
+
+  // persistent texture, stays bound to 'pixmap' until it gets damaged
+  GLuint texture;
+  bool texture_bound;
+  bool has_alpha;
+};
+
+// everything else, only touched when handling events
+struct DoteWindowInfo {
+  std::optional<std::string> name;
+  WindowType type;
+
+  std::optional<std::string> icon;  // base64 png
+
+  // name/type/icon only get re-read on PropertyNotify once these are set
+  bool metadata_cached;
+  bool icon_cached;
+
+  // changed since the last frame, sitting in pending_updates
+  bool update_pending;
+  // waiting in pending_icons
+  bool icon_pending;
+};
+
+// how to name a pixmap of a given depth, worked out once at startup
+struct PixmapFormat {
+  GLXFBConfig config;
+  int texture_format;
+};
+
+// texture units a single instanced draw call can sample from, gl 3.3
+// guarantees at least 16 in the fragment shader
+#define BATCH_TEXTURE_UNITS 16
+
+// per window data in the instance buffer, laid out to match the vertex shader
+struct WindowInstance {
+  float position[2];  // where the whole texture sits in gl coordinates
+  float size[2];
+  float cropped_position[2];  // the part of it that actually gets drawn
+  float cropped_size[2];
+  float depth;
+  float opacity;
+  int32_t slot;  // texture unit within the batch
+};
+
+// a window (or border) queued for drawing this frame
+struct DrawItem {
+  WindowInstance instance;
+  GLuint texture;
+
+  Rect rect;  // what it covers on screen, in pixels
+  bool opaque;
+  bool visible;
+
+  uint32_t order;  // position in the queue, breaks depth ties
+};
+
+struct InstanceBatch {
+  size_t first;
+  size_t count;
+  bool blend;
+
+  GLuint textures[BATCH_TEXTURE_UNITS];
+  int texture_count;
 };
 
 class DoteWindowManager {
@@ -86,7 +204,7 @@ class DoteWindowManager {
 
   void run();
 
-  int ipc_step() {
+  void inotify_step() {
     constexpr size_t inotify_buf_len =
         (1024 * (sizeof(struct inotify_event) + 16));
 
@@ -105,29 +223,26 @@ class DoteWindowManager {
         printf("file updated %s\n", watched_files[event->wd].c_str());
       }
 
-      Packet packet;
-      auto segment = packet.add_segments();
+      auto segment = outgoing_segment();
       // initialize
       segment->mutable_reload_reply();
-
-      size_t len = packet.ByteSizeLong();
-      char* buf = (char*)malloc(len);
-      packet.SerializeToArray(buf, len);
-
-      send_wrapper(ipc_sock, buf, len, 0);
-      free(buf);
     }
+  }
 
+  bool ipc_backlog() { return packet_ring.size() != 0; }
+
+  int ipc_step() {
     int count = 0;
     while (true) {
-      Packet packet;
-      {
-        std::lock_guard<std::mutex> packet_gaurd(packet_lock);
-        if (packet_queue.empty()) {
-          break;
-        }
-        packet = packet_queue.front();
-        packet_queue.pop();
+      // read in place, the slot goes back to the receive thread once every
+      // segment has been handled
+      Packet* packet = packet_ring.front();
+      if (!packet) {
+        break;
+      }
+      // out of time, the rest gets handled after the next frame
+      if (!ipc_budget.allow()) {
+        break;
       }
 
       can_receive--;
@@ -135,25 +250,28 @@ class DoteWindowManager {
       if (can_receive == 0) {
         can_receive = START_CAN_SEND;
 
-        Packet packet2;
-        auto request = packet2.add_segments();
+        Packet* packet2 = new_packet();
+        auto request = packet2->add_segments();
         auto processed = request->mutable_processed_reply();
         processed->set_can_send(can_receive);
-        size_t len2 = packet2.ByteSizeLong();
-        char* buf2 = (char*)malloc(len2);
-        packet2.SerializeToArray(buf2, len2);
 
-        nn_send(ipc_sock, buf2, len2, 0);
-        free(buf2);
+        // this is what gives the browser credit, it cant wait on credit
+        send_packet(*packet2, false);
       }
 
-      for (auto segment : packet.segments()) {
+      for (const auto& segment : packet->segments()) {
         count++;
         if (segment.data_case() == DataSegment::kProcessedRequest) {
           can_send = segment.processed_request().can_send();
         } else if (segment.data_case() == DataSegment::kWindowRequest) {
           register_base_window(segment.window_request().window());
+          scheduler.damage_all();
         } else if (segment.data_case() == DataSegment::kWindowMapRequest) {
+          // the configure notify damages the new position
+          if (DoteWindow* window =
+                  windows.find(segment.window_map_request().window())) {
+            damage_window(window);
+          }
           configure_window(segment.window_map_request().window(),
                            segment.window_map_request().x(),
                            segment.window_map_request().y(),
@@ -167,28 +285,32 @@ class DoteWindowManager {
           double inc = (1 / window_count) * 0.8;
           double depth = 0.8;
           for (uint64_t window : segment.window_reorder_request().windows()) {
-            if (windows.find(window) == windows.end()) {
+            DoteWindow* dote_window = windows.find(window);
+            if (!dote_window) {
               printf("Window %lu skipped\n", window);
               continue;
             }
-            windows[window].depth = depth;
+            dote_window->depth = depth;
             printf("Setting window %lu depth to %f\n", window, depth);
             depth -= inc;
           }
+          windows.mark_unsorted();
+          scheduler.damage_all();
         } else if (segment.data_case() == DataSegment::kWindowFocusRequest) {
-          focus_window(segment.mutable_window_focus_request()->window(), false);
+          focus_window(segment.window_focus_request().window(), false);
         } else if (segment.data_case() ==
                    DataSegment::kWindowRegisterBorderRequest) {
           register_border(
-              segment.mutable_window_register_border_request()->window(),
-              segment.mutable_window_register_border_request()->x(),
-              segment.mutable_window_register_border_request()->y(),
-              segment.mutable_window_register_border_request()->width(),
-              segment.mutable_window_register_border_request()->height());
+              segment.window_register_border_request().window(),
+              segment.window_register_border_request().x(),
+              segment.window_register_border_request().y(),
+              segment.window_register_border_request().width(),
+              segment.window_register_border_request().height());
         } else if (segment.data_case() == DataSegment::kRenderRequest) {
         } else if (segment.data_case() == DataSegment::kWindowCloseRequest) {
-          XDestroyWindow(display,
-                         segment.mutable_window_close_request()->window());
+          track_request("XDestroyWindow",
+                        segment.window_close_request().window());
+          XDestroyWindow(display, segment.window_close_request().window());
 
         } else if (segment.data_case() == DataSegment::kRunProgramRequest) {
           int pid = fork();
@@ -204,46 +326,46 @@ class DoteWindowManager {
             exit(1);
           }
         } else if (segment.data_case() == DataSegment::kFileRegisterRequest) {
+          AllocationExemption exemption;
           watched_files[inotify_add_watch(
               inotify_fd,
-              segment.mutable_file_register_request()->file_path().c_str(),
+              segment.file_register_request().file_path().c_str(),
               IN_MODIFY)] =
-              segment.mutable_file_register_request()->file_path();
+              segment.file_register_request().file_path();
         } else if (segment.data_case() == DataSegment::kBrowserStartRequest) {
           printf("resending all windows\n");
-          Packet packet;
-          for (auto window : windows) {
-            if (std::find(blacklisted_windows.begin(),
-                          blacklisted_windows.end(),
-                          window.first) != blacklisted_windows.end())
+          // once per browser start, might not fit in the packet arena
+          AllocationExemption exemption;
+          for (auto& window : windows) {
+            if (windows.blacklisted(window.window))
               continue;
-            if (base_window.value() == window.first)
+            if (base_window.value() == window.window)
               continue;
 
-            printf("%lu\n", window.first);
+            printf("%lu\n", window.window);
 
-            auto segment = packet.add_segments();
+            auto segment = outgoing_segment();
             auto reply = segment->mutable_window_map_reply();
-            reply->set_window(window.second.window);
-            reply->set_visible(window.second.visible);
-            reply->set_x(window.second.x);
-            reply->set_y(window.second.y);
-            if (window.second.name.has_value()) {
-              reply->set_name(window.second.name.value());
+            reply->set_window(window.window);
+            reply->set_visible(window.visible);
+            reply->set_x(window.x);
+            reply->set_y(window.y);
+            if (windows.info(&window).name.has_value()) {
+              reply->set_name(windows.info(&window).name.value());
             }
-            reply->set_width(window.second.width);
-            reply->set_height(window.second.height);
+            reply->set_width(window.width);
+            reply->set_height(window.height);
           }
-          size_t len = packet.ByteSizeLong();
-          char* buf = (char*)malloc(len);
-          packet.SerializeToArray(buf, len);
-
-          send_wrapper(ipc_sock, buf, len, 0);
-
-          free(buf);
         }
       }
+
+      packet_ring.pop();
+      // the receive thread stopped reading because we were full
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ipc_waiting_for_space.exchange(false))
+        signal_ring_space();
     }
+    packet_ring.report("ipc ring");
     return count;
   }
 
@@ -255,62 +377,152 @@ class DoteWindowManager {
       printf("ipc bind failed\n");
     }
 
-    // non-blocking
-    int to = 0;
-    if (nn_setsockopt(ipc_sock, NN_SOL_SOCKET, NN_RCVTIMEO, &to, sizeof(to)) <
+    // readable whenever nanomsg has a message for us, the receive thread
+    // sleeps on it and then reads without blocking
+    size_t fd_size = sizeof(ipc_fd);
+    if (nn_getsockopt(ipc_sock, NN_SOL_SOCKET, NN_RCVFD, &ipc_fd, &fd_size) <
         0) {
-      printf("ipc non_block failed\n");
+      printf("ipc rcvfd failed\n");
     }
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
     inotify_fd = inotify_init1(IN_NONBLOCK);
+    event_loop.watch(inotify_fd, EVENT_SOURCE_INOTIFY);
 
     nanomsg_thread = std::thread([this]() { nanomsg_watch(); });
   }
   ~DoteWindowManager() {
     should_stop = true;
+    // the join below never returns if this doesnt get through
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) != sizeof(one))
+      perror("ipc stop signal");
     if (nanomsg_thread.joinable()) {
       nanomsg_thread.join();
     }
+    close(stop_fd);
+    close(space_fd);
     close(inotify_fd);
     nn_close(ipc_sock);
   }
 
  private:
-  std::queue<Packet> packet_queue;
-  std::mutex packet_lock;
+  EventLoop event_loop;
+
+  // filled by the receive thread, drained by ipc_step(). the browser has at
+  // most START_CAN_SEND packets in flight before it waits for a
+  // ProcessedReply, so this only fills up if it ignores that
+  SpscRing<Packet, 256> packet_ring;
   std::thread nanomsg_thread;
   std::atomic<bool> should_stop{false};
+  // written by the destructor to get the receive thread out of poll()
+  int stop_fd = -1;
+  int ipc_fd = -1;
+  // the receive thread sleeps on this while the ring is full
+  int space_fd = -1;
+  std::atomic<bool> ipc_waiting_for_space{false};
+
+  // false if we're shutting down
+  bool wait_for_ring_space() {
+    ipc_waiting_for_space = true;
+    // ipc_step() might have popped before it could see the flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!packet_ring.full()) {
+      ipc_waiting_for_space = false;
+      return true;
+    }
+
+    struct pollfd fds[2] = {
+        {.fd = space_fd, .events = POLLIN},
+        {.fd = stop_fd, .events = POLLIN},
+    };
+    while (poll(fds, 2, -1) < 0 && errno == EINTR)
+      ;
+    if (fds[1].revents)
+      return false;
+
+    // EAGAIN if poll woke up without anything there, the caller just checks
+    // for room again
+    uint64_t drain;
+    if (read(space_fd, &drain, sizeof(drain)) < 0 && errno != EAGAIN)
+      perror("ipc ring space drain");
+    return true;
+  }
+
+  // wakes the receive thread out of wait_for_ring_space(). if this doesnt
+  // get through it stays asleep with the browser backed up behind it, so at
+  // least say so
+  void signal_ring_space() {
+    uint64_t one = 1;
+    ssize_t written;
+    do {
+      written = write(space_fd, &one, sizeof(one));
+    } while (written < 0 && errno == EINTR);
+
+    if (written != sizeof(one))
+      perror("ipc ring space signal");
+  }
 
   void nanomsg_watch() {
     char* buf = NULL;
     int result;
 
-    while (!should_stop) {
-      result = nn_recv(ipc_sock, &buf, NN_MSG, NN_DONTWAIT);
+    struct pollfd fds[2] = {
+        {.fd = ipc_fd, .events = POLLIN},
+        {.fd = stop_fd, .events = POLLIN},
+    };
 
-      if (result > 0) {
-        Packet packet;
-        packet.ParseFromArray(buf, result);
+    while (!should_stop) {
+      // sleeps until the browser sends something, no timeout
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        perror("ipc poll");
+        return;
+      }
+      if (fds[1].revents)
+        break;
+
+      // take everything that's there, the main loop gets woken up once
+      int received = 0;
+      while (true) {
+        Packet* slot = packet_ring.reserve();
+        if (!slot) {
+          // the main loop is behind, the rest waits in nanomsg until it
+          // catches up
+          if (received)
+            event_loop.wake();
+          received = 0;
+          if (!wait_for_ring_space())
+            return;
+          continue;
+        }
 
-        {
-          std::lock_guard<std::mutex> packet_guard(packet_lock);
-          packet_queue.push(packet);
+        result = nn_recv(ipc_sock, &buf, NN_MSG, NN_DONTWAIT);
+        if (result < 0) {
+          if (nn_errno() != EAGAIN)
+            fprintf(stderr, "nn_recv error: %s\n", nn_strerror(nn_errno()));
+          break;
         }
 
+        // parsed straight into the slot, the main loop reads it from there
+        slot->ParseFromArray(buf, result);
         nn_freemsg(buf);
-      } else if (result < 0 && nn_errno() == EAGAIN) {
-        // no data available, sleep briefly to avoid busy-waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-      } else if (result < 0) {
-        fprintf(stderr, "nn_recv error: %s\n", nn_strerror(nn_errno()));
+        packet_ring.commit();
+        received++;
       }
+
+      if (received)
+        event_loop.wake();
     }
   }
 
   uint64_t can_send = START_CAN_SEND;
   uint64_t can_receive = START_CAN_SEND;
+  // only ever called from the main loop, same as everything touching
+  // can_send, so it shares nothing with the receive thread
   void send_wrapper(int s, const void* buf, size_t len, int flags) {
-    std::lock_guard<std::mutex> packet_gaurd(packet_lock);
     if (can_send == 0)
       return;
     can_send--;
@@ -331,28 +543,41 @@ class DoteWindowManager {
   int xi_opcode;
 
   std::optional<Window> base_window;
-  Atom client_list_atom;
+  AtomTable atoms;
 
-  std::vector<Window> blacklisted_windows;
-  std::unordered_map<Window, DoteWindow> windows;
-  std::unordered_map<Window, Window> border_window;
-  std::vector<Window> render_order;
+  WindowRegistry<DoteWindow, DoteWindowInfo> windows;
+
+  int damage_event_base;
+  FrameScheduler scheduler;
+
+  VblankSource vblank_source = VblankSource::NOMINAL;
+  PFNGLXGETSYNCVALUESOMLPROC glXGetSyncValuesOML;
+  int glx_event_base;
+  // swaps handed to the driver, compared against its swap buffer count
+  int64_t swaps_queued = 0;
+  void sync_vblank();
 
   GLXFBConfig* glx_configs;
   int glx_config_count;
+
+  // keyed by visual depth
+  std::unordered_map<int, PixmapFormat> pixmap_formats;
+  void build_pixmap_formats();
   GLXContext glx_context;
 
   GLuint shader;
-  GLuint texture_uniform;
 
-  GLuint opacity_uniform;
-  GLuint depth_uniform;
+  GLuint quad_vao, quad_vbo, quad_ibo;
+  GLuint instance_vbo;
 
-  GLuint position_uniform;
-  GLuint size_uniform;
+  std::vector<DrawItem> draw_items;
+  std::vector<Rect> occluders;
+  std::vector<Rect> occlusion_scratch;
+  std::vector<Rect> occlusion_scratch2;
 
-  GLuint cropped_position_uniform;
-  GLuint cropped_size_uniform;
+  std::vector<WindowInstance> instances;
+  std::vector<GLuint> instance_textures;
+  std::vector<InstanceBatch> instance_batches;
 
   glXBindTexImageEXT_t glXBindTexImageEXT;
   glXReleaseTexImageEXT_t glXReleaseTexImageEXT;
@@ -364,6 +589,11 @@ class DoteWindowManager {
 
   bool process_events();
 
+  uint32_t wait_for_work(
+      std::optional<FrameScheduler::clock::time_point> deadline);
+
+  bool vsync = false;
+
   void register_base_window(Window base);
   void register_border(Window window,
                        int32_t x,
@@ -376,11 +606,37 @@ class DoteWindowManager {
                         uint32_t width,
                         uint32_t height);
 
-  void render_window(unsigned window_id);
+  void queue_window(DoteWindow* window);
+  void set_instance_attributes(size_t first);
+  void batch_instances(size_t first, size_t end, bool blend);
+  void render_windows(const Rect& repaint);
 
-  void bind_window_texture(Window window_index);
+  PresentMode present_mode;
+  glXCopySubBufferMESA_t glXCopySubBufferMESA;
+  void present(const Rect& repaint);
 
-  void unbind_window_texture(Window window_index);
+  Rect window_rect(DoteWindow* window);
+  std::optional<Rect> border_rect(DoteWindow* window);
+  void damage_window(DoteWindow* window);
+
+  // window and border rects of everything visible, for finding out what is
+  // under the pointer
+  SpatialGrid spatial_index;
+  void index_window(DoteWindow* window);
+
+  GrabMode grab_mode;
+  std::optional<LatencyProbe> latency_probe;
+
+  void refresh_textures();
+  bool window_texture_stale(DoteWindow* window);
+  void update_window_texture(DoteWindow* window);
+  bool window_pixmap_stale(DoteWindow* window);
+  void destroy_window_pixmap(DoteWindow* window);
+
+  // every pixmap, texture and buffer goes through here
+  GLResources resources;
+  // frees everything a window owns, once it's gone
+  void release_window(DoteWindow* window);
 
   float width_dimension_to_float(int pixels);
   float height_dimension_to_float(int pixels);
@@ -394,8 +650,105 @@ class DoteWindowManager {
   int float_to_x_coordinate(float x);
   int float_to_y_coordinate(float x);
 
+  // re-read a cached property, true if it changed
+  bool fetch_window_name(DoteWindow* window);
+  bool fetch_window_type(DoteWindow* window);
+  // sends the icon to the browser itself, only if it changed
+  void fetch_window_icon(DoteWindow* window);
+  void send_window_map_reply(DoteWindow* window);
+
+  // configure/map/unmap only record the latest state, the browser update and
+  // pixmap work happen once per frame for each window that changed
+  std::vector<Window> pending_updates;
+  void queue_window_update(DoteWindow* window);
+  void flush_window_updates();
+
+  // how much of each loop iteration x events, ipc packets and background
+  // work like icon encoding are allowed to take before the frame goes out
+  WorkBudget x_budget{"x events", std::chrono::microseconds(4000)};
+  WorkBudget ipc_budget{"ipc packets", std::chrono::microseconds(2000)};
+  WorkBudget background_budget{"background", std::chrono::microseconds(2000)};
+
+  std::queue<Window> pending_icons;
+  void queue_icon_update(DoteWindow* window);
+  void background_step();
+
   void update_client_list();
 
+  // cleared at the start of every loop iteration
+  FrameArena frame_arena{64 * 1024};
+  // serializes into the frame arena and sends it to the browser. only the
+  // ProcessedReply that hands out credit goes out without spending any
+  void send_packet(const Packet& packet, bool spend_credit = true);
+
+  // outgoing packets get built in here instead of on the heap, it's reset
+  // along with the frame arena
+  static google::protobuf::ArenaOptions packet_arena_options(char* block,
+                                                             size_t size) {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = block;
+    options.initial_block_size = size;
+    return options;
+  }
+  alignas(8) char packet_block[32 * 1024];
+  google::protobuf::Arena packet_arena{
+      packet_arena_options(packet_block, sizeof(packet_block))};
+  Packet* new_packet() {
+    return google::protobuf::Arena::Create<Packet>(&packet_arena);
+  }
+
+  // everything for the browser goes into one packet that is sent before the
+  // loop sleeps or starts over, so an iteration spends at most one credit
+  // however much it has to say. when the credit runs out the packet is held
+  // and the packet arena isnt reset until it went out
+  Packet* outgoing = nullptr;
+  bool outgoing_held = false;
+  DataSegment* outgoing_segment();
+  void flush_outgoing();
+
+  // room in the per frame vectors for every window we have, so a frame
+  // doesnt have to grow them
+  void reserve_frame_scratch();
+
+  // only counted when built with DOTE_COUNT_ALLOCATIONS, aborts if a loop
+  // iteration allocates once the wm has warmed up
+  void check_loop_allocations(uint64_t allocations);
+
+  // remember the serial of the next request for error reporting
+  void track_request(const char* request, unsigned long resource);
+
+  // raw motion only says the pointer moved, its position gets queried and
+  // sent to the browser at most once per 'pointer_period()'
+  bool pointer_moved = false;
+  int pointer_x = -1, pointer_y = -1;
+  FrameScheduler::clock::time_point last_pointer_query;
+  // DOTE_POINTER_INTERVAL_US, otherwise once per refresh
+  std::optional<FrameScheduler::clock::duration> pointer_interval;
+  FrameScheduler::clock::duration pointer_period();
+  // server time of the newest raw motion and how many were folded into the
+  // next forward, so the browser can tell when the pointer actually moved
+  Time pointer_time = 0;
+  uint32_t pointer_coalesced = 0;
+  // the last forwarded position that hasnt made it into a packet yet
+  bool pointer_unsent = false;
+  Time pointer_unsent_time = 0;
+  uint32_t pointer_unsent_coalesced = 0;
+  // DOTE_SYNTHETIC_POINTER=0 stops faking x events for the base window, for
+  // uis that only listen to the ipc pointer events
+  bool synthetic_pointer = true;
+  void forward_pointer();
+  void send_pointer_press(int x,
+                          int y,
+                          unsigned int button,
+                          bool down,
+                          Time time);
+
+  ClickMode click_mode;
+  ClickLatency click_latency;
+  void grab_clicks(Window window);
+  void ungrab_clicks(Window window);
+  void raw_button(XIRawEvent* raw, bool down);
+
   std::optional<Window> focused_window;
   void focus_window(Window window_id, bool send_event);
 };
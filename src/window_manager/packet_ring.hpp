@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// bounded queue between exactly one producer thread and one consumer thread,
+// no locks. the elements live in the ring itself: the producer fills a slot
+// in place and hands it over with commit(), the consumer works on it where it
+// is and gives it back with pop(). nothing gets copied or moved, and once
+// every slot has been used the elements keep their memory for the next round
+template <typename T, size_t capacity>
+class SpscRing {
+  static_assert(capacity && (capacity & (capacity - 1)) == 0,
+                "capacity has to be a power of two");
+
+ public:
+  // producer side. the slot to fill next, or nullptr if the consumer still
+  // has all of them
+  T* reserve() {
+    size_t head = head_index.load(std::memory_order_relaxed);
+    if (head - tail_index.load(std::memory_order_acquire) == capacity) {
+      full_count.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &slots[head & (capacity - 1)];
+  }
+
+  // producer side, publishes the slot from reserve()
+  void commit() {
+    size_t head = head_index.load(std::memory_order_relaxed) + 1;
+    head_index.store(head, std::memory_order_release);
+    pushed_count.fetch_add(1, std::memory_order_relaxed);
+
+    size_t depth = head - tail_index.load(std::memory_order_acquire);
+    if (depth > high_water_mark.load(std::memory_order_relaxed))
+      high_water_mark.store(depth, std::memory_order_relaxed);
+  }
+
+  // consumer side. the oldest committed slot, or nullptr if there is none
+  T* front() {
+    size_t tail = tail_index.load(std::memory_order_relaxed);
+    if (head_index.load(std::memory_order_acquire) == tail)
+      return nullptr;
+    return &slots[tail & (capacity - 1)];
+  }
+
+  // consumer side, hands the slot from front() back to the producer
+  void pop() {
+    tail_index.store(tail_index.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+  }
+
+  // either side, may be stale by the time it returns
+  size_t size() const {
+    return head_index.load(std::memory_order_acquire) -
+           tail_index.load(std::memory_order_acquire);
+  }
+  bool full() const { return size() == capacity; }
+
+  size_t high_water() const {
+    return high_water_mark.load(std::memory_order_relaxed);
+  }
+  uint64_t pushed() const {
+    return pushed_count.load(std::memory_order_relaxed);
+  }
+  uint64_t full_stalls() const {
+    return full_count.load(std::memory_order_relaxed);
+  }
+
+  // consumer side
+  void report(const char* name) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_report < report_interval)
+      return;
+    last_report = now;
+
+    uint64_t total = pushed();
+    if (total == last_pushed)
+      return;
+
+    printf(
+        "%s: %lu received, depth %zu, high water %zu of %zu, full %lu "
+        "times\n",
+        name, total - last_pushed, size(), high_water(), capacity,
+        full_stalls());
+    last_pushed = total;
+  }
+
+ private:
+  static constexpr std::chrono::seconds report_interval{10};
+
+  T slots[capacity];
+
+  // free running, only ever compared and masked. each lives on its own cache
+  // line so the two threads dont keep stealing it from each other
+  alignas(64) std::atomic<size_t> head_index{0};  // written by the producer
+  alignas(64) std::atomic<size_t> tail_index{0};  // written by the consumer
+
+  // producer writes, anyone reads
+  alignas(64) std::atomic<size_t> high_water_mark{0};
+  std::atomic<uint64_t> pushed_count{0};
+  std::atomic<uint64_t> full_count{0};
+
+  // consumer only
+  uint64_t last_pushed = 0;
+  std::chrono::steady_clock::time_point last_report =
+      std::chrono::steady_clock::now();
+};
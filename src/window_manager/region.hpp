@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+// screen space rectangle in pixels
+struct Rect {
+  int x, y;
+  int width, height;
+
+  bool empty() const { return width <= 0 || height <= 0; }
+
+  Rect intersect(const Rect& other) const {
+    int x1 = std::max(x, other.x);
+    int y1 = std::max(y, other.y);
+    int x2 = std::min(x + width, other.x + other.width);
+    int y2 = std::min(y + height, other.y + other.height);
+    return {x1, y1, x2 - x1, y2 - y1};
+  }
+
+  // smallest rect containing both
+  Rect bounds(const Rect& other) const {
+    int x1 = std::min(x, other.x);
+    int y1 = std::min(y, other.y);
+    int x2 = std::max(x + width, other.x + other.width);
+    int y2 = std::max(y + height, other.y + other.height);
+    return {x1, y1, x2 - x1, y2 - y1};
+  }
+
+  bool overlaps(const Rect& other) const {
+    return !intersect(other).empty();
+  }
+};
+
+// appends whatever is left of 'rect' after cutting 'hole' out of it, at most
+// four pieces
+inline void rect_subtract(const Rect& rect,
+                          const Rect& hole,
+                          std::vector<Rect>& out) {
+  Rect overlap = rect.intersect(hole);
+  if (overlap.empty()) {
+    out.push_back(rect);
+    return;
+  }
+
+  // strips above and below the hole span the whole width
+  if (overlap.y > rect.y) {
+    out.push_back({rect.x, rect.y, rect.width, overlap.y - rect.y});
+  }
+  int overlap_bottom = overlap.y + overlap.height;
+  int rect_bottom = rect.y + rect.height;
+  if (rect_bottom > overlap_bottom) {
+    out.push_back({rect.x, overlap_bottom, rect.width,
+                   rect_bottom - overlap_bottom});
+  }
+
+  // and the ones to the sides only span the hole's height
+  if (overlap.x > rect.x) {
+    out.push_back({rect.x, overlap.y, overlap.x - rect.x, overlap.height});
+  }
+  int overlap_right = overlap.x + overlap.width;
+  int rect_right = rect.x + rect.width;
+  if (rect_right > overlap_right) {
+    out.push_back(
+        {overlap_right, overlap.y, rect_right - overlap_right, overlap.height});
+  }
+}
+
+// true if 'occluders' together cover every pixel of 'rect'. the scratch
+// vectors never grow past what they were reserved to, if the uncovered part
+// breaks up into more pieces than that it just says no
+inline bool rect_covered(const Rect& rect,
+                         const std::vector<Rect>& occluders,
+                         std::vector<Rect>& scratch,
+                         std::vector<Rect>& scratch2) {
+  if (scratch.capacity() == 0)
+    return false;
+
+  scratch.clear();
+  scratch.push_back(rect);
+
+  for (const Rect& occluder : occluders) {
+    scratch2.clear();
+    for (const Rect& piece : scratch) {
+      // a subtraction leaves at most four pieces
+      if (scratch2.size() + 4 > scratch2.capacity())
+        return false;
+      rect_subtract(piece, occluder, scratch2);
+    }
+    std::swap(scratch, scratch2);
+
+    if (scratch.empty())
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <X11/X.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "allocation_counter.hpp"
+#include "region.hpp"
+
+// uniform grid over the screen for "what is under this point" questions.
+// every cell lists the windows whose bounds touch it, so a lookup only has
+// to look at the handful of windows near the pointer instead of all of them.
+//
+// it only knows about bounds, depth and everything else gets looked up from
+// the window itself so restacking doesnt have to touch the grid
+class SpatialGrid {
+ public:
+  static constexpr int cell_size = 128;
+
+  void resize(int width, int height) {
+    columns = std::max(1, (width + cell_size - 1) / cell_size);
+    rows = std::max(1, (height + cell_size - 1) / cell_size);
+
+    cells.assign(columns * rows, {});
+    for (auto& entry : bounds) {
+      if (!entry.second.empty())
+        insert(entry.first, entry.second);
+    }
+  }
+
+  // 'rect' is everything the window covers, an empty one takes it out
+  void update(Window id, const Rect& rect) {
+    auto found = bounds.find(id);
+    if (found == bounds.end()) {
+      if (rect.empty())
+        return;
+
+      // a window we havent seen before
+      AllocationExemption exemption;
+      found = bounds.emplace(id, Rect{}).first;
+    }
+
+    Rect& current = found->second;
+    if (current.x == rect.x && current.y == rect.y &&
+        current.width == rect.width && current.height == rect.height)
+      return;
+
+    // the entry stays around while the window is hidden, so moving and
+    // mapping a window never allocates
+    if (!current.empty())
+      erase(id, current);
+    current = rect;
+    if (!rect.empty())
+      insert(id, rect);
+  }
+
+  void remove(Window id) { update(id, {}); }
+
+  // the window is gone for good
+  void forget(Window id) {
+    remove(id);
+    bounds.erase(id);
+  }
+
+  // every window whose bounds might contain the point, in no particular order
+  const std::vector<Window>& at(int x, int y) const {
+    static const std::vector<Window> nothing;
+
+    if (cells.empty() || x < 0 || y < 0)
+      return nothing;
+
+    int column = x / cell_size;
+    int row = y / cell_size;
+    if (column >= columns || row >= rows)
+      return nothing;
+
+    return cells[row * columns + column];
+  }
+
+ private:
+  // the cells 'rect' touches, clamped to the screen
+  template <typename Visit>
+  void for_cells(const Rect& rect, Visit visit) {
+    if (cells.empty())
+      return;
+
+    int column_start = std::clamp(rect.x / cell_size, 0, columns - 1);
+    int row_start = std::clamp(rect.y / cell_size, 0, rows - 1);
+    int column_end =
+        std::clamp((rect.x + rect.width - 1) / cell_size, 0, columns - 1);
+    int row_end =
+        std::clamp((rect.y + rect.height - 1) / cell_size, 0, rows - 1);
+
+    for (int row = row_start; row <= row_end; row++) {
+      for (int column = column_start; column <= column_end; column++) {
+        visit(cells[row * columns + column]);
+      }
+    }
+  }
+
+  void insert(Window id, const Rect& rect) {
+    for_cells(rect, [&](std::vector<Window>& cell) {
+      // more windows in this cell than it ever had
+      if (cell.size() == cell.capacity()) {
+        AllocationExemption exemption;
+        cell.push_back(id);
+        return;
+      }
+      cell.push_back(id);
+    });
+  }
+
+  void erase(Window id, const Rect& rect) {
+    for_cells(rect, [&](std::vector<Window>& cell) {
+      auto found = std::find(cell.begin(), cell.end(), id);
+      if (found == cell.end())
+        return;
+      *found = cell.back();
+      cell.pop_back();
+    });
+  }
+
+  int columns = 0;
+  int rows = 0;
+  std::vector<std::vector<Window>> cells;
+
+  // what each window was last put in the grid with
+  std::unordered_map<Window, Rect> bounds;
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <X11/X.h>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// every window the wm knows about. the fields the renderer reads every frame
+// ('Hot') sit in one dense array in stacking order, bottom to top, so a frame
+// walks straight through memory. names, icons and other stuff only events
+// care about ('Cold') live in a parallel array at the same index so they
+// dont get dragged through the cache with it.
+//
+// pointers into the registry are only good until the next insert, erase or
+// restack, hold on to the x id instead. Hot needs a 'window' member with the
+// x id in it
+template <typename Hot, typename Cold>
+class WindowRegistry {
+ public:
+  using iterator = typename std::vector<Hot>::iterator;
+
+  Hot* find(Window id) {
+    auto found = indices.find(id);
+    if (found == indices.end())
+      return nullptr;
+    return &hot[found->second];
+  }
+
+  // a fresh entry on top of the stack, replacing whatever had the id before
+  Hot* insert(Window id) {
+    erase(id);
+
+    indices[id] = hot.size();
+    hot.push_back({});
+    cold.push_back({});
+    unsorted = true;
+
+    // restack has room for everything right away instead of growing in the
+    // middle of a frame
+    order.reserve(hot.capacity());
+    sorted_hot.reserve(hot.capacity());
+    sorted_cold.reserve(cold.capacity());
+    return &hot.back();
+  }
+
+  void erase(Window id) {
+    auto found = indices.find(id);
+    if (found == indices.end())
+      return;
+
+    uint32_t index = found->second;
+    indices.erase(found);
+
+    // keep the stacking order, everything above moves down one
+    hot.erase(hot.begin() + index);
+    cold.erase(cold.begin() + index);
+    for (auto& entry : indices) {
+      if (entry.second > index)
+        entry.second--;
+    }
+  }
+
+  Cold& info(const Hot* window) { return cold[window - hot.data()]; }
+
+  size_t size() const { return hot.size(); }
+  iterator begin() { return hot.begin(); }
+  iterator end() { return hot.end(); }
+
+  // something that decides the stacking order changed
+  void mark_unsorted() { unsorted = true; }
+
+  // put the arrays back in stacking order if anything moved, 'below' says
+  // whether 'a' is under 'b'. keeps the relative order of ties
+  template <typename Compare>
+  void restack(Compare below) {
+    if (!unsorted)
+      return;
+    unsorted = false;
+
+    order.resize(hot.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+      order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      if (below(hot[a], hot[b]))
+        return true;
+      if (below(hot[b], hot[a]))
+        return false;
+      return a < b;
+    });
+
+    sorted_hot.clear();
+    sorted_cold.clear();
+    for (uint32_t index : order) {
+      sorted_hot.push_back(std::move(hot[index]));
+      sorted_cold.push_back(std::move(cold[index]));
+    }
+    hot.swap(sorted_hot);
+    cold.swap(sorted_cold);
+
+    for (uint32_t i = 0; i < hot.size(); i++)
+      indices[hot[i].window] = i;
+  }
+
+  // windows that belong to the wm itself and never get managed
+  void blacklist(Window id) { blacklisted_ids.insert(id); }
+  bool blacklisted(Window id) const {
+    return blacklisted_ids.find(id) != blacklisted_ids.end();
+  }
+
+ private:
+  std::vector<Hot> hot;
+  std::vector<Cold> cold;
+  std::unordered_map<Window, uint32_t> indices;
+
+  std::unordered_set<Window> blacklisted_ids;
+
+  bool unsorted = false;
+
+  // scratch for restack, kept around so it doesnt allocate every time
+  std::vector<uint32_t> order;
+  std::vector<Hot> sorted_hot;
+  std::vector<Cold> sorted_cold;
+};
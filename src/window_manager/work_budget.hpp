@@ -0,0 +1,101 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+
+// caps how long one kind of work gets each time round the main loop so a
+// burst of it cant hold up the next frame. whatever doesnt fit waits for the
+// next turn, the frame goes out in between.
+//
+// also keeps track of how much of the budget actually got used and prints
+// it every now and then
+class WorkBudget {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  WorkBudget(const char* name, clock::duration budget)
+      : name(name), budget(budget) {}
+
+  // 'deadline' cuts the slice short when a frame has to start rendering
+  // before the budget would run out
+  void start(std::optional<clock::time_point> deadline = {}) {
+    started = clock::now();
+    stop_at = started + budget;
+    if (deadline.has_value() && deadline.value() < stop_at)
+      stop_at = deadline.value();
+    items = 0;
+  }
+
+  // call before each item, false means stop and leave the rest for later.
+  // the first item always gets through so nothing starves
+  bool allow() {
+    if (items > 0 && clock::now() >= stop_at) {
+      exhausted = true;
+      return false;
+    }
+    items++;
+    return true;
+  }
+
+  void stop() {
+    auto used = clock::now() - started;
+
+    if (items > 0) {
+      slices++;
+      total_items += items;
+      total_used += used;
+      if (used > max_used)
+        max_used = used;
+    }
+    if (exhausted)
+      slices_exhausted++;
+    exhausted = false;
+
+    report();
+  }
+
+ private:
+  static constexpr std::chrono::seconds report_interval{10};
+
+  void report() {
+    auto now = clock::now();
+    if (now - last_report < report_interval)
+      return;
+    last_report = now;
+
+    if (slices == 0)
+      return;
+
+    auto ms = [](clock::duration duration) {
+      return std::chrono::duration<double, std::milli>(duration).count();
+    };
+    printf(
+        "%s: %lu items in %lu slices, avg %.2fms max %.2fms of %.2fms, "
+        "over budget %lu times\n",
+        name, total_items, slices, ms(total_used) / slices, ms(max_used),
+        ms(budget), slices_exhausted);
+
+    slices = 0;
+    slices_exhausted = 0;
+    total_items = 0;
+    total_used = {};
+    max_used = {};
+  }
+
+  const char* name;
+  clock::duration budget;
+
+  clock::time_point started;
+  clock::time_point stop_at;
+  uint64_t items = 0;
+  bool exhausted = false;
+
+  uint64_t slices = 0;
+  uint64_t slices_exhausted = 0;
+  uint64_t total_items = 0;
+  clock::duration total_used = {};
+  clock::duration max_used = {};
+
+  clock::time_point last_report = clock::now();
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+// without XSynchronize errors show up long after the request that caused
+// them, so remember what the last few interesting requests were for by
+// serial and look the error up when it arrives
+class XRequestLog {
+ public:
+  struct Entry {
+    unsigned long serial;
+    const char* request;
+    unsigned long resource;
+  };
+
+  void record(unsigned long serial,
+              const char* request,
+              unsigned long resource) {
+    entries[head] = {serial, request, resource};
+    head = (head + 1) % capacity;
+  }
+
+  // the newest request sent at or before 'serial', the error came either
+  // from it or from something untracked right after it
+  const Entry* find(unsigned long serial) const {
+    const Entry* best = nullptr;
+    for (const Entry& entry : entries) {
+      if (entry.request == nullptr || entry.serial > serial)
+        continue;
+      if (best == nullptr || entry.serial > best->serial)
+        best = &entry;
+    }
+    return best;
+  }
+
+ private:
+  static constexpr size_t capacity = 256;
+
+  Entry entries[capacity] = {};
+  size_t head = 0;
+};